@@ -0,0 +1,206 @@
+#pragma once
+
+#include "sampler.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Every metric of one snapshot flattened into a single array, filled by
+// visitMetrics(). Metrics are numbered in visit order, which never changes,
+// so rules can refer to them by number. A scalar has length 1.
+struct AlertInputs {
+    std::vector<const char*> names; // names are string literals
+    std::vector<double> values;
+    std::vector<uint32_t> offset;
+    std::vector<uint32_t> length;
+
+    void clear() {
+        names.clear();
+        values.clear();
+        offset.clear();
+        length.clear();
+    }
+
+    void scalar(const char* name, double value, int) {
+        add(name, 1);
+        values.push_back(value);
+    }
+
+    template <class T>
+    void array(const char* name, const std::vector<T>& vs, int) {
+        add(name, (uint32_t)vs.size());
+        values.insert(values.end(), vs.begin(), vs.end());
+    }
+
+private:
+    void add(const char* name, uint32_t n) {
+        names.push_back(name);
+        offset.push_back((uint32_t)values.size());
+        length.push_back(n);
+    }
+};
+
+// Threshold rules evaluated once per snapshot on the sampler thread, so the
+// cost is O(rules) per tick whatever the number of subscribers. Rules are
+// compiled into flat arrays: each tick resolves a value per rule and steps
+// a three-state machine (ok, pending, firing) with comparisons folded into
+// one sign-adjusted test.
+class AlertEngine {
+public:
+    enum State : uint8_t { Ok, Pending, Firing };
+
+    struct Rule {
+        std::string name;
+        std::string metric;
+        std::string key;    // element of an array metric, by name
+        int index = -1;     // element of an array metric, by position
+        std::string op;     // >, >=, < or <=
+        double threshold = 0;
+        double clear = NAN; // back below (or above) this to resolve; defaults to threshold
+        int64_t forMs = 0;  // breached this long before firing
+    };
+
+    struct Transition {
+        size_t rule;
+        State state; // Firing or Ok (resolved)
+        double value;
+    };
+
+    struct Status {
+        State state;
+        double value;
+        int64_t sinceMs;
+    };
+
+    // Compiles one rule against the metric layout in `schema`. Returns false
+    // with a reason for unknown metrics or operators.
+    bool add(const Rule& rule, const AlertInputs& schema, const std::vector<ArrayLabels>& keys, std::string& error) {
+        size_t m = 0;
+        while (m < schema.names.size() && rule.metric != schema.names[m]) m++;
+        if (m == schema.names.size()) {
+            error = "unknown metric " + rule.metric;
+            return false;
+        }
+
+        double sign;
+        bool inclusive;
+        if (rule.op == ">" || rule.op == ">=") sign = 1;
+        else if (rule.op == "<" || rule.op == "<=") sign = -1;
+        else {
+            error = "unknown operator " + rule.op;
+            return false;
+        }
+        inclusive = rule.op.size() == 2;
+
+        int keyList = -1;
+        if (!rule.key.empty()) {
+            size_t best = 0;
+            for (size_t k = 0; k < keys.size(); k++) {
+                size_t len = strlen(keys[k].prefix);
+                if (len > best && rule.metric.compare(0, len, keys[k].prefix) == 0) {
+                    best = len;
+                    keyList = (int)k;
+                }
+            }
+            if (keyList < 0 || !keys[keyList].names) {
+                error = "metric " + rule.metric + " has no element names";
+                return false;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        rules_.push_back(rule);
+        metric_.push_back((uint32_t)m);
+        index_.push_back(rule.key.empty() && rule.index > 0 ? rule.index : 0); // 0 for scalars
+        keyList_.push_back(keyList);
+        sign_.push_back(sign);
+        threshold_.push_back(sign * rule.threshold);
+        clear_.push_back(sign * (std::isnan(rule.clear) ? rule.threshold : rule.clear));
+        inclusive_.push_back(inclusive);
+        forMs_.push_back(rule.forMs);
+        state_.push_back(Ok);
+        since_.push_back(0);
+        value_.push_back(NAN);
+        return true;
+    }
+
+    size_t size() const { return rules_.size(); }
+    const Rule& rule(size_t i) const { return rules_[i]; }
+
+    // Steps every rule against this snapshot's values and appends the rules
+    // that started firing or resolved. A missing value (an array element
+    // that is gone) counts as not breached.
+    void evaluate(const AlertInputs& in, const std::vector<ArrayLabels>& keys, int64_t nowMs,
+                  std::vector<Transition>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const double missing = std::numeric_limits<double>::quiet_NaN();
+        for (size_t i = 0; i < rules_.size(); i++) {
+            uint32_t m = metric_[i];
+            uint32_t idx = keyList_[i] < 0 ? (uint32_t)index_[i] : resolve(i, keys[keyList_[i]].names);
+            double v = idx < in.length[m] ? in.values[in.offset[m] + idx] : missing;
+            value_[i] = v;
+
+            // NaN fails every comparison: no breach, and a firing rule resolves.
+            double sv = sign_[i] * v;
+            bool breach = (sv > threshold_[i]) | (inclusive_[i] & (sv == threshold_[i]));
+            bool held = sv > clear_[i];
+            bool due = nowMs - since_[i] >= forMs_[i];
+
+            State s = (State)state_[i];
+            State next = s == Firing ? (held ? Firing : Ok)
+                : !breach ? Ok
+                : (s == Pending && due) || forMs_[i] == 0 ? Firing : Pending;
+            if (next == s) continue;
+
+            state_[i] = next;
+            since_[i] = nowMs;
+            if (next == Firing || s == Firing) out.push_back({i, next, v});
+        }
+    }
+
+    std::vector<Status> status() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Status> out(rules_.size());
+        for (size_t i = 0; i < rules_.size(); i++) {
+            out[i] = {(State)state_[i], value_[i], since_[i]};
+        }
+        return out;
+    }
+
+private:
+    // The element named by rule i's key, checked against the position it
+    // had last tick before searching. Returns an out-of-range index if gone.
+    uint32_t resolve(size_t i, const std::vector<std::string>* names) {
+        if (!names) return UINT32_MAX;
+        int32_t& cached = index_[i];
+        const std::string& key = rules_[i].key;
+        if ((size_t)cached < names->size() && (*names)[cached] == key) return (uint32_t)cached;
+        for (size_t n = 0; n < names->size(); n++) {
+            if ((*names)[n] == key) {
+                cached = (int32_t)n;
+                return (uint32_t)n;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<Rule> rules_;
+    // One entry per rule.
+    std::vector<uint32_t> metric_;
+    std::vector<int32_t> index_; // fixed position, or the cached one of a key
+    std::vector<int> keyList_;
+    std::vector<double> sign_;   // -1 turns < into >
+    std::vector<double> threshold_;
+    std::vector<double> clear_;
+    std::vector<uint8_t> inclusive_;
+    std::vector<int64_t> forMs_;
+    std::vector<uint8_t> state_;
+    std::vector<int64_t> since_;
+    std::vector<double> value_;
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// Compact binary encoding of the metric stream (?format=bin).
+//
+// The stream is a sequence of frames, each a varint payload length followed
+// by the payload. The first payload byte is the frame type:
+//
+//   Schema: varint field count, then per field a varint name length, the
+//           name bytes, one kind byte (0 scalar, 1 array), one byte of
+//           fixed-point decimals and a varint element count.
+//   Delta:  varint sequence number, then one zig-zag varint per element,
+//           the change of value * 10^decimals since the previous frame.
+//
+// A schema frame resets the decoder's baseline to zero, so the delta frame
+// right after it carries absolute values. That pair is the key frame every
+// new subscriber starts with.
+//
+// Subscribers on different intervals see different snapshots, so deltas
+// are kept per interval: each is against the last snapshot taken for that
+// interval. Figures measured over the interval itself (CPU percentages) can
+// differ per interval too, so such an interval also gets its own key frame.
+
+// One interval's delta frame, valid for a subscriber whose last frame was
+// snapshot `baseSeq`, and its key frame if it differs from the shared one.
+struct BinaryDelta {
+    uint32_t intervalMs;
+    uint64_t baseSeq;
+    std::string frame;
+    std::string key;
+};
+
+class BinaryEncoder {
+public:
+    enum FrameType : uint8_t { SchemaFrame = 1, DeltaFrame = 2 };
+
+    void begin() {
+        fields_.clear();
+        values_.clear();
+        overrides_.clear();
+    }
+
+    void scalar(const char* name, double value, int decimals) {
+        fields_.push_back({name, false, (uint8_t)decimals, 1});
+        values_.push_back(toFixed(value, decimals));
+    }
+
+    template <class T>
+    void array(const char* name, const std::vector<T>& values, int decimals) {
+        fields_.push_back({name, true, (uint8_t)decimals, (uint32_t)values.size()});
+        for (T v : values) values_.push_back(toFixed((double)v, decimals));
+    }
+
+    // Gives scalar `name` another value for the subscribers of `intervalMs`,
+    // such as a CPU figure over that interval's own window. Call it after
+    // the scalar itself was added.
+    void scalarFor(uint32_t intervalMs, const char* name, double value) {
+        size_t pos = 0;
+        for (const Field& f : fields_) {
+            if (!f.isArray && strcmp(f.name, name) == 0) {
+                overrides_.push_back({intervalMs, pos, toFixed(value, f.decimals)});
+                return;
+            }
+            pos += f.length;
+        }
+    }
+
+    // Encodes the fields added since begin(). `key` gets a schema frame and
+    // absolute values; `deltas` gets, for each of `intervals`, the change
+    // since the last finish() for that interval, or its key frame when the
+    // schema changed in between. Intervals not seen for two periods are
+    // forgotten.
+    void finish(uint64_t seq, int64_t timestampMs, const std::vector<uint32_t>& intervals,
+                std::string& key, std::vector<BinaryDelta>& deltas) {
+        key.clear();
+        deltas.clear();
+        writeKey(key, seq, values_);
+
+        for (uint32_t interval : intervals) {
+            intervalValues_ = values_;
+            bool overridden = false;
+            for (const Override& o : overrides_) {
+                if (o.intervalMs != interval) continue;
+                intervalValues_[o.pos] = o.value;
+                overridden = true;
+            }
+
+            Baseline& base = baselines_[interval];
+            deltas.push_back({interval, base.seq, std::string(), std::string()});
+            BinaryDelta& delta = deltas.back();
+            if (overridden) writeKey(delta.key, seq, intervalValues_);
+            if (base.seq != 0 && sameSchema(base.fields)) {
+                payload_.clear();
+                writeValues(payload_, seq, intervalValues_, &base.values);
+                appendFrame(delta.frame, payload_);
+            } else {
+                delta.frame = overridden ? delta.key : key;
+            }
+            base.seq = seq;
+            base.timestampMs = timestampMs;
+            base.fields = fields_;
+            base.values = intervalValues_;
+        }
+
+        for (auto it = baselines_.begin(); it != baselines_.end();) {
+            bool stale = timestampMs - it->second.timestampMs > 2 * (int64_t)it->first;
+            it = stale ? baselines_.erase(it) : std::next(it);
+        }
+    }
+
+private:
+    struct Field {
+        const char* name;
+        bool isArray;
+        uint8_t decimals;
+        uint32_t length;
+    };
+
+    static int64_t toFixed(double value, int decimals) {
+        static const double scales[] = {1, 10, 100, 1000, 10000};
+        if (!std::isfinite(value)) return 0;
+        return (int64_t)std::llround(value * scales[decimals]);
+    }
+
+    static void putVarint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((char)v);
+    }
+
+    static uint64_t zigzag(int64_t v) {
+        return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    }
+
+    static void appendFrame(std::string& out, const std::string& payload) {
+        putVarint(out, payload.size());
+        out += payload;
+    }
+
+    void writeSchema(std::string& out) const {
+        out.push_back((char)SchemaFrame);
+        putVarint(out, fields_.size());
+        for (const Field& f : fields_) {
+            size_t len = strlen(f.name);
+            putVarint(out, len);
+            out.append(f.name, len);
+            out.push_back((char)(f.isArray ? 1 : 0));
+            out.push_back((char)f.decimals);
+            putVarint(out, f.length);
+        }
+    }
+
+    // A schema frame followed by absolute `values`.
+    void writeKey(std::string& out, uint64_t seq, const std::vector<int64_t>& values) {
+        payload_.clear();
+        writeSchema(payload_);
+        appendFrame(out, payload_);
+
+        payload_.clear();
+        writeValues(payload_, seq, values, nullptr);
+        appendFrame(out, payload_);
+    }
+
+    static void writeValues(std::string& out, uint64_t seq, const std::vector<int64_t>& values,
+                            const std::vector<int64_t>* baseline) {
+        out.push_back((char)DeltaFrame);
+        putVarint(out, seq);
+        for (size_t i = 0; i < values.size(); i++) {
+            int64_t base = baseline ? (*baseline)[i] : 0;
+            putVarint(out, zigzag(values[i] - base));
+        }
+    }
+
+    bool sameSchema(const std::vector<Field>& prevFields) const {
+        if (fields_.size() != prevFields.size()) return false;
+        for (size_t i = 0; i < fields_.size(); i++) {
+            const Field& a = fields_[i];
+            const Field& b = prevFields[i];
+            if (a.length != b.length || a.decimals != b.decimals ||
+                a.isArray != b.isArray || strcmp(a.name, b.name) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The last snapshot encoded for one interval.
+    struct Baseline {
+        uint64_t seq = 0;
+        int64_t timestampMs = 0;
+        std::vector<Field> fields;
+        std::vector<int64_t> values;
+    };
+
+    // A value replaced for one interval's subscribers; `pos` indexes values_.
+    struct Override {
+        uint32_t intervalMs;
+        size_t pos;
+        int64_t value;
+    };
+
+    std::vector<Field> fields_;
+    std::vector<int64_t> values_;
+    std::vector<Override> overrides_;
+    std::vector<int64_t> intervalValues_;
+    std::map<uint32_t, Baseline> baselines_;
+    std::string payload_;
+};
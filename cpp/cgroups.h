@@ -0,0 +1,284 @@
+#pragma once
+
+#include "pressure.h"
+#include "proc_reader.h"
+#include "sampler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Per-cgroup CPU, memory, I/O and pid counts from a cgroup v2 hierarchy.
+//
+// Every cgroup directory and its stat files are opened once when the tree is
+// walked and re-read with pread() each tick. The tree is only walked again
+// when inotify reports a cgroup created or removed.
+//
+// Only leaf cgroups are read. cgroup v2 keeps processes in leaves, so each
+// parent (a pod, a QoS class, a slice) is the sum of its children and costs
+// no reads; the sums are built bottom-up in one pass over the node list.
+// Pressure is the exception: it is already hierarchical and cannot be
+// summed, so the *.pressure files of every streamed cgroup are read.
+class CgroupTree {
+public:
+    ~CgroupTree() {
+        clear();
+        if (inotifyFd_ >= 0) ::close(inotifyFd_);
+    }
+
+    bool open(std::string root, int maxDepth) {
+        root_ = std::move(root);
+        maxDepth_ = maxDepth;
+        buf_.resize(8192);
+        dents_.resize(16384);
+        return walk();
+    }
+
+    bool read(CgroupStats& out) {
+        if (nodes_.empty()) return false;
+        if (changed() && !walk()) return false;
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRead_).count();
+        bool first = lastRead_ == std::chrono::steady_clock::time_point();
+        lastRead_ = now;
+
+        for (Node& n : nodes_) n.cur = Counters();
+        for (Node& n : nodes_) {
+            if (n.leaf) readLeaf(n);
+        }
+        // Children always come after their parent, so a reverse pass adds
+        // every subtree into its parent.
+        for (size_t i = nodes_.size(); i-- > 1;) {
+            nodes_[nodes_[i].parent].cur += nodes_[i].cur;
+        }
+        for (Node& n : nodes_) {
+            if (n.depth <= maxDepth_) readPressure(n);
+        }
+
+        for (Node& n : nodes_) {
+            if (n.depth <= maxDepth_) {
+                bool rates = !first && n.valid;
+                auto rate = [&](uint64_t c, uint64_t p) { return rates && c >= p ? (c - p) / elapsed : 0.0; };
+                out.path.push_back(n.path.empty() ? "/" : n.path);
+                out.cpu.push_back((float)(rate(n.cur.usageUsec, n.prev.usageUsec) / 1e4));
+                out.memory.push_back((double)n.cur.memory);
+                out.memoryAnon.push_back((double)n.cur.anon);
+                out.memoryFile.push_back((double)n.cur.file);
+                out.ioRead.push_back(rate(n.cur.ioRead, n.prev.ioRead));
+                out.ioWrite.push_back(rate(n.cur.ioWrite, n.prev.ioWrite));
+                out.pids.push_back((uint32_t)n.cur.pids);
+                out.cpuPressure.push_back((float)(rate(n.cur.cpuStall, n.prev.cpuStall) / 1e4));
+                out.memoryPressure.push_back((float)(rate(n.cur.memoryStall, n.prev.memoryStall) / 1e4));
+                out.ioPressure.push_back((float)(rate(n.cur.ioStall, n.prev.ioStall) / 1e4));
+            }
+            n.prev = n.cur;
+            n.valid = true;
+        }
+        return true;
+    }
+
+private:
+    struct Counters {
+        uint64_t usageUsec = 0;
+        uint64_t memory = 0;
+        uint64_t anon = 0;
+        uint64_t file = 0;
+        uint64_t ioRead = 0;
+        uint64_t ioWrite = 0;
+        uint64_t pids = 0;
+        // "some" stall time in microseconds; each cgroup's own, not summed.
+        uint64_t cpuStall = 0;
+        uint64_t memoryStall = 0;
+        uint64_t ioStall = 0;
+
+        Counters& operator+=(const Counters& o) {
+            usageUsec += o.usageUsec;
+            memory += o.memory;
+            anon += o.anon;
+            file += o.file;
+            ioRead += o.ioRead;
+            ioWrite += o.ioWrite;
+            pids += o.pids;
+            return *this;
+        }
+    };
+
+    struct Node {
+        std::string path; // relative to the root, "" for the root itself
+        size_t parent = 0;
+        int depth = 0;
+        int dirFd = -1;
+        bool leaf = true;
+        ProcFile cpuStat, memoryCurrent, memoryStat, ioStat, pidsCurrent;
+        ProcFile cpuPressure, memoryPressure, ioPressure; // streamed cgroups only
+        Counters cur, prev;
+        bool valid = false; // prev holds a reading
+    };
+
+    struct Dirent {
+        uint64_t ino;
+        int64_t off;
+        unsigned short reclen;
+        unsigned char type;
+        char name[1];
+    };
+
+    // Drains inotify; true if any cgroup was created or removed.
+    bool changed() {
+        alignas(inotify_event) char events[4096];
+        bool any = false;
+        while (::read(inotifyFd_, events, sizeof(events)) > 0) any = true;
+        return any;
+    }
+
+    void clear() {
+        for (Node& n : nodes_) {
+            if (n.dirFd >= 0) ::close(n.dirFd);
+        }
+        nodes_.clear();
+    }
+
+    // Rebuilds the node list depth first, carrying previous counters over by
+    // path so rates continue across a re-walk.
+    bool walk() {
+        std::unordered_map<std::string, Counters> previous;
+        for (Node& n : nodes_) {
+            if (n.valid) previous.emplace(n.path, n.prev);
+        }
+        clear();
+
+        if (inotifyFd_ >= 0) ::close(inotifyFd_);
+        inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        int rootFd = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (rootFd < 0) return false;
+        // A cgroup v2 mount, not the tmpfs holding v1 controller mounts.
+        if (faccessat(rootFd, "cgroup.controllers", F_OK, 0) != 0) {
+            ::close(rootFd);
+            return false;
+        }
+        nodes_.emplace_back();
+        nodes_[0].dirFd = rootFd;
+        addNode(0);
+
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            listChildren(i);
+        }
+        for (Node& n : nodes_) {
+            auto it = previous.find(n.path);
+            if (it != previous.end()) {
+                n.prev = it->second;
+                n.valid = true;
+            }
+        }
+        return true;
+    }
+
+    void addNode(size_t i) {
+        Node& n = nodes_[i];
+        std::string dir = n.path.empty() ? root_ : root_ + "/" + n.path;
+        inotify_add_watch(inotifyFd_, dir.c_str(), IN_CREATE | IN_DELETE | IN_ONLYDIR);
+        n.cpuStat.openAt(n.dirFd, "cpu.stat");
+        n.memoryCurrent.openAt(n.dirFd, "memory.current");
+        n.memoryStat.openAt(n.dirFd, "memory.stat");
+        n.ioStat.openAt(n.dirFd, "io.stat");
+        n.pidsCurrent.openAt(n.dirFd, "pids.current");
+        if (n.depth <= maxDepth_) {
+            n.cpuPressure.openAt(n.dirFd, "cpu.pressure");
+            n.memoryPressure.openAt(n.dirFd, "memory.pressure");
+            n.ioPressure.openAt(n.dirFd, "io.pressure");
+        }
+    }
+
+    // Appends the child cgroups of node i; they are listed later in turn.
+    void listChildren(size_t i) {
+        if (lseek(nodes_[i].dirFd, 0, SEEK_SET) != 0) return;
+        for (;;) {
+            long n = syscall(SYS_getdents64, nodes_[i].dirFd, dents_.data(), dents_.size());
+            if (n <= 0) break;
+            for (long off = 0; off < n;) {
+                const Dirent* d = (const Dirent*)(dents_.data() + off);
+                off += d->reclen;
+                if (d->type != DT_DIR || d->name[0] == '.') continue;
+
+                int fd = ::openat(nodes_[i].dirFd, d->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd < 0) continue;
+                Node child;
+                child.path = nodes_[i].path.empty() ? d->name : nodes_[i].path + "/" + d->name;
+                child.parent = i;
+                child.depth = nodes_[i].depth + 1;
+                child.dirFd = fd;
+                nodes_[i].leaf = false;
+                nodes_.push_back(std::move(child));
+                addNode(nodes_.size() - 1);
+            }
+        }
+    }
+
+    void readLeaf(Node& n) {
+        ssize_t len;
+        if ((len = n.cpuStat.read(buf_.data(), buf_.size())) > 0) {
+            ProcTokenizer tok(buf_.data(), (size_t)len);
+            if (tok.findLine("usage_usec")) tok.number(n.cur.usageUsec);
+        }
+        if ((len = n.memoryCurrent.read(buf_.data(), buf_.size())) > 0) {
+            ProcTokenizer tok(buf_.data(), (size_t)len);
+            tok.number(n.cur.memory);
+        }
+        if ((len = n.memoryStat.read(buf_.data(), buf_.size())) > 0) {
+            ProcTokenizer tok(buf_.data(), (size_t)len);
+            if (tok.findLine("anon ")) tok.number(n.cur.anon);
+            if (tok.findLine("file ")) tok.number(n.cur.file);
+        }
+        if ((len = n.ioStat.read(buf_.data(), buf_.size())) > 0) {
+            // One "MAJ:MIN rbytes=.. wbytes=.. rios=.. ..." line per device.
+            const char* p = buf_.data();
+            const char* end = p + len;
+            while (p < end) {
+                const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+                if (!nl) nl = end;
+                n.cur.ioRead += keyValue(p, nl, "rbytes=");
+                n.cur.ioWrite += keyValue(p, nl, "wbytes=");
+                p = nl + 1;
+            }
+        }
+        if ((len = n.pidsCurrent.read(buf_.data(), buf_.size())) > 0) {
+            ProcTokenizer tok(buf_.data(), (size_t)len);
+            tok.number(n.cur.pids);
+        }
+    }
+
+    void readPressure(Node& n) {
+        uint64_t full;
+        readPressureTotals(n.cpuPressure, buf_.data(), buf_.size(), n.cur.cpuStall, full);
+        readPressureTotals(n.memoryPressure, buf_.data(), buf_.size(), n.cur.memoryStall, full);
+        readPressureTotals(n.ioPressure, buf_.data(), buf_.size(), n.cur.ioStall, full);
+    }
+
+    static uint64_t keyValue(const char* p, const char* end, const char* key) {
+        size_t keyLen = strlen(key);
+        const char* k = (const char*)memmem(p, (size_t)(end - p), key, keyLen);
+        if (!k) return 0;
+        uint64_t v = 0;
+        ProcTokenizer tok(k + keyLen, (size_t)(end - k - keyLen));
+        tok.number(v);
+        return v;
+    }
+
+    std::string root_;
+    int maxDepth_ = 0;
+    int inotifyFd_ = -1;
+    std::vector<Node> nodes_; // parents before children; 0 is the root
+    std::vector<char> buf_;
+    std::vector<char> dents_;
+    std::chrono::steady_clock::time_point lastRead_;
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "proc_reader.h"
+#include "sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// CPU and memory of the cgroup this process runs in, relative to its limits
+// rather than to the host. Reads the cgroup's own cpu.stat, memory.current,
+// memory.stat and cpuset.cpus.effective, plus cpu.max and memory.max of the
+// cgroup and every ancestor, since a pod or slice limit binds its children
+// just as a container limit does. All files stay open and limits are re-read
+// each tick, so a resized container is picked up without a restart.
+class ContainerLimits {
+public:
+    // `root` is the cgroup v2 mount. Returns false outside a v2 hierarchy.
+    bool open(const std::string& root) {
+        buf_.resize(4096);
+        int rootFd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (rootFd < 0) return false;
+        if (faccessat(rootFd, "cgroup.controllers", F_OK, 0) != 0) {
+            ::close(rootFd);
+            return false;
+        }
+
+        // The unified hierarchy's "0::/path" line. With a cgroup namespace
+        // this is "/" and the mount is the container's own cgroup; a path
+        // that is not under this mount falls back to its root.
+        std::vector<int> dirs{rootFd};
+        std::string self = ownCgroup();
+        for (size_t start = 1; start < self.size();) {
+            size_t end = self.find('/', start);
+            if (end == std::string::npos) end = self.size();
+            std::string name = self.substr(start, end - start);
+            int fd = ::openat(dirs.back(), name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) {
+                for (size_t i = 1; i < dirs.size(); i++) ::close(dirs[i]);
+                dirs.resize(1);
+                break;
+            }
+            dirs.push_back(fd);
+            start = end + 1;
+        }
+
+        // Own cgroup first, then its ancestors up to the mount root.
+        levels_.clear();
+        for (size_t i = dirs.size(); i-- > 0;) {
+            Level l;
+            l.cpuMax.openAt(dirs[i], "cpu.max");
+            l.memoryMax.openAt(dirs[i], "memory.max");
+            l.cpuStat.openAt(dirs[i], "cpu.stat");
+            levels_.push_back(std::move(l));
+        }
+        memoryCurrent_.openAt(dirs.back(), "memory.current");
+        memoryStat_.openAt(dirs.back(), "memory.stat");
+        cpusEffective_.openAt(dirs.back(), "cpuset.cpus.effective");
+        for (int fd : dirs) ::close(fd);
+        return levels_[0].cpuStat.isOpen();
+    }
+
+    // `hostCpus` and `hostMemory` stand in for limits that are not set.
+    bool read(ContainerStats& out, int hostCpus, double hostMemory) {
+        if (levels_.empty()) return false;
+
+        // The tightest quota, and the cgroup it belongs to, whose cpu.stat
+        // counts the throttling it causes.
+        double quota = 0;
+        size_t binding = 0;
+        for (size_t i = 0; i < levels_.size(); i++) {
+            double cores = cpuQuota(levels_[i]);
+            if (cores > 0 && (quota == 0 || cores < quota)) {
+                quota = cores;
+                binding = i;
+            }
+        }
+        double cpus = cpusetSize();
+        double limit = hostCpus > 0 ? hostCpus : 1;
+        if (cpus > 0) limit = std::min(limit, cpus);
+        if (quota > 0) limit = std::min(limit, quota);
+
+        CpuCounters cur;
+        if (!readCpuStat(levels_[0], cur)) return false;
+        if (binding > 0) {
+            CpuCounters parent;
+            readCpuStat(levels_[binding], parent);
+            parent.usageUsec = cur.usageUsec;
+            cur = parent;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRead_).count();
+        bool first = lastRead_ == std::chrono::steady_clock::time_point() || binding != binding_;
+        lastRead_ = now;
+        binding_ = binding;
+
+        out.cpuLimit = limit;
+        if (!first) {
+            auto delta = [](uint64_t c, uint64_t p) { return c >= p ? (double)(c - p) : 0.0; };
+            out.cpu = delta(cur.usageUsec, prev_.usageUsec) / elapsed / (limit * 1e6) * 100;
+            out.throttledMs = delta(cur.throttledUsec, prev_.throttledUsec) / elapsed / 1e3;
+            double periods = delta(cur.periods, prev_.periods);
+            out.throttledPeriods = periods > 0
+                ? delta(cur.throttledPeriods, prev_.throttledPeriods) / periods * 100 : 0;
+        }
+        prev_ = cur;
+
+        double memoryLimit = hostMemory;
+        for (Level& l : levels_) {
+            uint64_t v;
+            if (readLimit(l.memoryMax, v) && (memoryLimit <= 0 || v < memoryLimit)) memoryLimit = (double)v;
+        }
+        out.memoryLimit = memoryLimit;
+        out.memoryUsed = workingSet();
+        return true;
+    }
+
+private:
+    struct Level {
+        ProcFile cpuMax, memoryMax, cpuStat;
+    };
+
+    struct CpuCounters {
+        uint64_t usageUsec = 0;
+        uint64_t periods = 0;
+        uint64_t throttledPeriods = 0;
+        uint64_t throttledUsec = 0;
+    };
+
+    static std::string ownCgroup() {
+        ProcFile file("/proc/self/cgroup");
+        char buf[4096];
+        ssize_t len = file.read(buf, sizeof(buf));
+        if (len <= 0) return "/";
+        ProcTokenizer tok(buf, (size_t)len);
+        if (!tok.findLine("0::")) return "/";
+        const char* start = tok.pos() + 3;
+        const char* end = (const char*)memchr(start, '\n', (size_t)(buf + len - start));
+        return std::string(start, end ? end : buf + len);
+    }
+
+    // "max 100000" or "$QUOTA $PERIOD"; returns cores, 0 when unlimited.
+    double cpuQuota(Level& l) {
+        ssize_t len = l.cpuMax.read(buf_.data(), buf_.size());
+        if (len <= 0 || buf_[0] == 'm') return 0;
+        uint64_t quota = 0, period = 0;
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        if (!tok.number(quota) || !tok.number(period) || period == 0) return 0;
+        return (double)quota / (double)period;
+    }
+
+    // A byte count, or false for "max".
+    bool readLimit(ProcFile& file, uint64_t& v) {
+        ssize_t len = file.read(buf_.data(), buf_.size());
+        if (len <= 0 || buf_[0] == 'm') return false;
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        return tok.number(v);
+    }
+
+    bool readCpuStat(Level& l, CpuCounters& c) {
+        ssize_t len = l.cpuStat.read(buf_.data(), buf_.size());
+        if (len <= 0) return false;
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        do {
+            if (tok.startsWith("usage_usec ", 11)) tok.number(c.usageUsec);
+            else if (tok.startsWith("nr_periods ", 11)) tok.number(c.periods);
+            else if (tok.startsWith("nr_throttled ", 13)) tok.number(c.throttledPeriods);
+            else if (tok.startsWith("throttled_usec ", 15)) tok.number(c.throttledUsec);
+        } while (tok.nextLine());
+        return true;
+    }
+
+    // Number of CPUs in a list such as "0-3,8,10-11"; 0 if unreadable.
+    double cpusetSize() {
+        ssize_t len = cpusEffective_.read(buf_.data(), buf_.size());
+        if (len <= 0) return 0;
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        uint64_t count = 0, first = 0, last = 0;
+        while (tok.number(first)) {
+            last = first;
+            if (tok.startsWith("-", 1)) tok.number(last);
+            if (last >= first) count += last - first + 1;
+        }
+        return (double)count;
+    }
+
+    // memory.current less inactive page cache, as the kubelet counts it
+    // against the limit: inactive file pages are reclaimed before an OOM.
+    double workingSet() {
+        uint64_t current = 0, inactive = 0;
+        ssize_t len = memoryCurrent_.read(buf_.data(), buf_.size());
+        if (len <= 0) return 0;
+        ProcTokenizer(buf_.data(), (size_t)len).number(current);
+        if ((len = memoryStat_.read(buf_.data(), buf_.size())) > 0) {
+            ProcTokenizer tok(buf_.data(), (size_t)len);
+            if (tok.findLine("inactive_file ")) tok.number(inactive);
+        }
+        return inactive < current ? (double)(current - inactive) : 0.0;
+    }
+
+    std::vector<Level> levels_; // own cgroup first, then ancestors
+    ProcFile memoryCurrent_, memoryStat_, cpusEffective_;
+    std::vector<char> buf_;
+    CpuCounters prev_;
+    size_t binding_ = 0;
+    std::chrono::steady_clock::time_point lastRead_;
+};
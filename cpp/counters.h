@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Columns of a /proc/stat cpu line, in kernel order. Platforms that do not
+// report a state leave it at 0.
+enum CpuState {
+    CpuUser, CpuNice, CpuSystem, CpuIdle, CpuIoWait,
+    CpuIrq, CpuSoftIrq, CpuSteal, CpuGuest, CpuGuestNice,
+    CpuStateCount
+};
+
+// Raw, monotonically increasing CPU counters read at one instant. Host
+// counters and process counters use the same unit as `wall` on each
+// platform (clock ticks on Linux, 100 ns on Windows).
+struct CpuCounters {
+    std::chrono::steady_clock::time_point taken;
+
+    uint64_t states[CpuStateCount] = {};
+
+    uint64_t procUser = 0;
+    uint64_t procSys = 0;
+    uint64_t wall = 0;
+};
+
+// Ticks spent busy and in total between two sets of state counters. Guest
+// time is already included in user time by the kernel, so it is skipped.
+inline bool cpuDeltas(const uint64_t* older, const uint64_t* newer,
+                      uint64_t& busy, uint64_t& total) {
+    busy = 0;
+    total = 0;
+    for (int s = 0; s < CpuGuest; s++) {
+        if (newer[s] < older[s]) return false;
+        uint64_t d = newer[s] - older[s];
+        total += d;
+        if (s != CpuIdle && s != CpuIoWait) busy += d;
+    }
+    return true;
+}
+
+// Host CPU busy percentage between two readings, or -1 if a counter wrapped.
+inline double cpuPercent(const CpuCounters& older, const CpuCounters& newer) {
+    uint64_t busy, total;
+    if (!cpuDeltas(older.states, newer.states, busy, total)) return -1.0;
+    if (total == 0) return 0.0;
+
+    return (double)busy / total * 100.0;
+}
+
+// Share of host CPU time spent in one state between two readings, or -1 if
+// a counter wrapped.
+inline double cpuStatePercent(const CpuCounters& older, const CpuCounters& newer,
+                              CpuState state) {
+    uint64_t busy, total;
+    if (!cpuDeltas(older.states, newer.states, busy, total)) return -1.0;
+    if (total == 0) return 0.0;
+
+    return (double)(newer.states[state] - older.states[state]) / total * 100.0;
+}
+
+// CPU percentage used by this process between two readings, normalised to
+// the number of processors, or -1 if a counter wrapped.
+inline double cpuProcessPercent(const CpuCounters& older, const CpuCounters& newer,
+                                int numProcessors) {
+    if (newer.wall < older.wall || newer.procSys < older.procSys ||
+        newer.procUser < older.procUser || numProcessors <= 0) {
+        return -1.0;
+    }
+    if (newer.wall == older.wall) return 0.0;
+
+    double percent = (double)(newer.procSys - older.procSys) +
+                     (double)(newer.procUser - older.procUser);
+    percent /= (double)(newer.wall - older.wall);
+    percent /= numProcessors;
+    return percent * 100.0;
+}
+
+// Fixed-size ring of time-stamped counter readings written by the sampler.
+// Readers pick any window out of it, so subscribers with different refresh
+// rates never disturb each other's deltas and never trigger extra reads.
+// At the fastest snapshot rate (100 ms) it reaches back about 100 s; longer
+// windows get the oldest reading.
+class CounterRing {
+public:
+    static constexpr size_t Capacity = 1024;
+
+    void push(const CpuCounters& c) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[head_] = c;
+        head_ = (head_ + 1) % Capacity;
+        if (size_ < Capacity) size_++;
+    }
+
+    // Finds the newest reading and the one whose age relative to it is
+    // closest to `window`, so timestamp jitter between ticks never doubles
+    // the window. Falls back to the oldest reading when the ring does not
+    // reach back that far. Returns false with fewer than two readings.
+    bool window(std::chrono::steady_clock::duration window,
+                CpuCounters& older, CpuCounters& newer) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (size_ < 2) return false;
+
+        newer = at(0);
+        size_t best = 1;
+        auto bestError = std::chrono::steady_clock::duration::max();
+        for (size_t i = 1; i < size_; i++) {
+            auto age = newer.taken - at(i).taken;
+            auto error = age >= window ? age - window : window - age;
+            if (error < bestError) {
+                best = i;
+                bestError = error;
+            }
+            if (age >= window) break;
+        }
+        older = at(best);
+        return true;
+    }
+
+private:
+    // i-th newest reading; caller holds the lock.
+    const CpuCounters& at(size_t i) const {
+        return slots_[(head_ + Capacity - 1 - i) % Capacity];
+    }
+
+    mutable std::mutex mutex_;
+    std::array<CpuCounters, Capacity> slots_{};
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+// Per-core CPU counters as a structure of arrays: times[state][core]. Each
+// state is one contiguous array so deltas over all cores vectorize.
+struct CoreTimes {
+    size_t cores = 0;
+    std::vector<uint64_t> times[CpuStateCount];
+
+    void resize(size_t n) {
+        cores = n;
+        for (auto& column : times) column.assign(n, 0);
+    }
+};
+
+// Busy and steal percentages per core between two readings. Scratch
+// vectors are reused across calls, so steady state does not allocate.
+class CoreUtilisation {
+public:
+    void compute(const CoreTimes& older, const CoreTimes& newer,
+                 std::vector<float>& busy, std::vector<float>& steal) {
+        size_t n = older.cores < newer.cores ? older.cores : newer.cores;
+        busyTicks_.assign(n, 0);
+        totalTicks_.assign(n, 0);
+
+        for (int s = 0; s < CpuGuest; s++) {
+            const uint64_t* a = older.times[s].data();
+            const uint64_t* b = newer.times[s].data();
+            uint64_t* total = totalTicks_.data();
+            for (size_t i = 0; i < n; i++) total[i] += b[i] - a[i];
+            if (s == CpuIdle || s == CpuIoWait) continue;
+            uint64_t* busyOut = busyTicks_.data();
+            for (size_t i = 0; i < n; i++) busyOut[i] += b[i] - a[i];
+        }
+
+        busy.resize(n);
+        steal.resize(n);
+        const uint64_t* stealA = older.times[CpuSteal].data();
+        const uint64_t* stealB = newer.times[CpuSteal].data();
+        for (size_t i = 0; i < n; i++) {
+            float total = (float)totalTicks_[i];
+            bool valid = totalTicks_[i] > 0 && busyTicks_[i] <= totalTicks_[i];
+            busy[i] = valid ? (float)busyTicks_[i] / total * 100.0f : 0.0f;
+            steal[i] = valid ? (float)(stealB[i] - stealA[i]) / total * 100.0f : 0.0f;
+        }
+    }
+
+private:
+    std::vector<uint64_t> busyTicks_;
+    std::vector<uint64_t> totalTicks_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "counters.h"
+#include "proc_reader.h"
+
+#include <vector>
+
+// Parses the cpu lines at the top of /proc/stat: the aggregate "cpu" row and
+// one "cpuN" row per online core. Stops at the first non-cpu line, so the
+// long intr/softirq rows below are never tokenized.
+class ProcStatReader {
+public:
+    bool open() {
+        // Roughly one 128-byte row per core plus the aggregate row; grown on
+        // demand if the cpu rows do not fit.
+        buf_.resize(16384);
+        return file_.open("/proc/stat");
+    }
+
+    bool read(uint64_t (&total)[CpuStateCount], CoreTimes& cores) {
+        ssize_t len;
+        for (;;) {
+            len = file_.read(buf_.data(), buf_.size());
+            if (len <= 0) return false;
+            if ((size_t)len < buf_.size() - 1 || containsNonCpuLine((size_t)len)) break;
+            buf_.resize(buf_.size() * 2);
+        }
+
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        if (!tok.startsWith("cpu ", 4)) return false;
+        parseRow(tok, total);
+
+        while (tok.nextLine() && tok.startsWith("cpu", 3)) {
+            tok.skip(3);
+            uint64_t core;
+            if (!tok.number(core)) break;
+
+            if (core >= cores.cores) grow(cores, core + 1);
+            uint64_t row[CpuStateCount] = {};
+            parseRow(tok, row);
+            for (int s = 0; s < CpuStateCount; s++) cores.times[s][core] = row[s];
+        }
+        return true;
+    }
+
+private:
+    // Reads up to CpuStateCount columns; older kernels report fewer.
+    static void parseRow(ProcTokenizer& tok, uint64_t (&row)[CpuStateCount]) {
+        for (int s = 0; s < CpuStateCount; s++) {
+            if (!tok.number(row[s])) break;
+        }
+    }
+
+    static void grow(CoreTimes& cores, size_t n) {
+        cores.cores = n;
+        for (auto& column : cores.times) column.resize(n, 0);
+    }
+
+    bool containsNonCpuLine(size_t len) const {
+        ProcTokenizer tok(buf_.data(), len);
+        while (tok.nextLine()) {
+            if (!tok.startsWith("cpu", 3)) return true;
+        }
+        return false;
+    }
+
+    ProcFile file_;
+    std::vector<char> buf_;
+};
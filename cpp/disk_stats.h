@@ -0,0 +1,146 @@
+#pragma once
+
+#include "proc_reader.h"
+#include "sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Parses /proc/diskstats into per-device counters. Partitions and loop/ram
+// devices are filtered through a device table that is built from the first
+// read and rebuilt only when the (major, minor) list changes.
+class DiskStatsReader {
+public:
+    bool open() {
+        buf_.resize(16384);
+        return file_.open("/proc/diskstats");
+    }
+
+    bool read(DiskStats& out) {
+        ssize_t len;
+        for (;;) {
+            len = file_.read(buf_.data(), buf_.size());
+            if (len <= 0) return false;
+            if ((size_t)len < buf_.size() - 1) break;
+            buf_.resize(buf_.size() * 2);
+        }
+
+        rows_.clear();
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        do {
+            Row r;
+            if (!tok.number(r.major) || !tok.number(r.minor)) continue;
+            tok.skipSpaces();
+            r.nameOffset = (size_t)(tok.pos() - buf_.data());
+            tok.skipWord();
+            r.nameLength = (size_t)(tok.pos() - buf_.data()) - r.nameOffset;
+            for (int f = 0; f < FieldCount; f++) {
+                if (!tok.number(r.fields[f])) break;
+            }
+            rows_.push_back(r);
+        } while (tok.nextLine());
+
+        if (changed()) rebuild();
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRead_).count();
+        bool first = lastRead_ == std::chrono::steady_clock::time_point();
+        lastRead_ = now;
+
+        for (size_t i = 0; i < rows_.size(); i++) {
+            Device& d = devices_[i];
+            if (!d.included) continue;
+            const uint64_t* cur = rows_[i].fields;
+            if (!first && d.valid) addRates(d, cur, elapsed, out);
+            std::copy(cur, cur + FieldCount, d.previous);
+            d.valid = true;
+        }
+        return true;
+    }
+
+private:
+    // Columns after the device name, as numbered in the kernel's iostats
+    // documentation (minus one).
+    enum { Reads, ReadsMerged, SectorsRead, MsReading,
+           Writes, WritesMerged, SectorsWritten, MsWriting,
+           InFlight, MsDoingIo, FieldCount };
+
+    struct Row {
+        uint64_t major = 0, minor = 0;
+        size_t nameOffset = 0, nameLength = 0;
+        uint64_t fields[FieldCount] = {};
+    };
+
+    struct Device {
+        uint64_t major, minor;
+        std::string name;
+        bool included;
+        bool valid = false; // previous holds a reading
+        uint64_t previous[FieldCount] = {};
+    };
+
+    bool changed() const {
+        if (rows_.size() != devices_.size()) return true;
+        for (size_t i = 0; i < rows_.size(); i++) {
+            if (rows_[i].major != devices_[i].major || rows_[i].minor != devices_[i].minor) return true;
+        }
+        return false;
+    }
+
+    // Keeps the counters of devices that are still present.
+    void rebuild() {
+        std::vector<Device> old;
+        old.swap(devices_);
+        for (const Row& r : rows_) {
+            Device d;
+            d.major = r.major;
+            d.minor = r.minor;
+            d.name.assign(buf_.data() + r.nameOffset, r.nameLength);
+            d.included = isWholeDisk(d.name);
+            for (const Device& o : old) {
+                if (o.major == d.major && o.minor == d.minor && o.valid) {
+                    d.valid = true;
+                    std::copy(o.previous, o.previous + FieldCount, d.previous);
+                }
+            }
+            devices_.push_back(std::move(d));
+        }
+    }
+
+    // Whole disks are the entries of /sys/block, where '/' in a name
+    // becomes '!'. Loop and ramdisk devices are left out.
+    static bool isWholeDisk(const std::string& name) {
+        if (name.compare(0, 4, "loop") == 0 || name.compare(0, 3, "ram") == 0) return false;
+        std::string path = "/sys/block/" + name;
+        for (size_t i = 11; i < path.size(); i++) {
+            if (path[i] == '/') path[i] = '!';
+        }
+        return access(path.c_str(), F_OK) == 0;
+    }
+
+    static void addRates(const Device& d, const uint64_t* cur, double elapsed, DiskStats& out) {
+        auto delta = [&](int f) { return cur[f] >= d.previous[f] ? (double)(cur[f] - d.previous[f]) : 0.0; };
+        double ios = delta(Reads) + delta(Writes);
+        double ms = delta(MsReading) + delta(MsWriting);
+
+        out.name.push_back(d.name);
+        out.readIops.push_back((float)(delta(Reads) / elapsed));
+        out.writeIops.push_back((float)(delta(Writes) / elapsed));
+        out.readBytes.push_back(delta(SectorsRead) * 512 / elapsed);
+        out.writeBytes.push_back(delta(SectorsWritten) * 512 / elapsed);
+        out.awaitMs.push_back(ios > 0 ? (float)(ms / ios) : 0.0f);
+        out.util.push_back((float)std::min(100.0, delta(MsDoingIo) / (elapsed * 1000) * 100));
+    }
+
+    ProcFile file_;
+    std::vector<char> buf_;
+    std::vector<Row> rows_;
+    std::vector<Device> devices_; // same order as the rows of the file
+    std::chrono::steady_clock::time_point lastRead_;
+};
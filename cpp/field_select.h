@@ -0,0 +1,127 @@
+#pragma once
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A set of JSON stream fields picked with ?metrics=, shared by every
+// subscriber that asked for the same set. Its frame is joined from the
+// snapshot's pre-serialized fields once per tick and interval (the CPU
+// figures differ per interval), by whichever subscriber needs it first.
+class FieldSelection {
+public:
+    using Frame = std::shared_ptr<const std::string>;
+
+    explicit FieldSelection(std::vector<uint16_t> fields) : fields_(std::move(fields)) {}
+
+    Frame frame(const SnapshotPtr& snap, uint32_t intervalMs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (seq_ != snap->seq) {
+            frames_.clear();
+            seq_ = snap->seq;
+        }
+        for (auto& entry : frames_) {
+            if (entry.first == intervalMs) return entry.second;
+        }
+
+        const Snapshot::CpuWindow* window = snap->cpuWindow(intervalMs);
+        auto out = std::make_shared<std::string>();
+        out->reserve(lastSize_);
+        *out += "data: {";
+        for (size_t i = 0; i < fields_.size(); i++) {
+            uint16_t f = fields_[i];
+            if (f + 1u >= snap->fieldEnds.size()) continue;
+            if (out->back() != '{') *out += ',';
+            snap->appendField(*out, f, window);
+        }
+        *out += "}\n\n";
+        lastSize_ = out->size();
+        frames_.emplace_back(intervalMs, std::move(out));
+        return frames_.back().second;
+    }
+
+private:
+    std::vector<uint16_t> fields_;
+    std::mutex mutex_;
+    uint64_t seq_ = 0;
+    std::vector<std::pair<uint32_t, Frame>> frames_; // per interval, for seq_
+    size_t lastSize_ = 0;
+};
+
+// Resolves ?metrics=cpu,used_ram,cgroup_* into field indices once, when a
+// subscriber connects. Patterns are comma separated and may use '*' (".*"
+// is read the same way); "status" is always included. Subscribers with the
+// same resulting set share one FieldSelection.
+class FieldSelector {
+public:
+    // The stream's field names, in frame order.
+    void setFields(std::vector<std::string> names) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        names_ = std::move(names);
+    }
+
+    // Null when `spec` is empty, meaning every field.
+    std::shared_ptr<FieldSelection> select(const std::string& spec) {
+        if (spec.empty()) return nullptr;
+
+        std::vector<std::string> patterns;
+        for (size_t start = 0; start <= spec.size();) {
+            size_t end = std::min(spec.find(',', start), spec.size());
+            std::string p = spec.substr(start, end - start);
+            for (size_t dot; (dot = p.find(".*")) != std::string::npos;) p.erase(dot, 1);
+            if (!p.empty()) patterns.push_back(std::move(p));
+            start = end + 1;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<uint16_t> fields;
+        for (size_t i = 0; i < names_.size(); i++) {
+            bool match = names_[i] == "status";
+            for (size_t p = 0; p < patterns.size() && !match; p++) match = glob(patterns[p].c_str(), names_[i].c_str());
+            if (match) fields.push_back((uint16_t)i);
+        }
+
+        // Drop sets nobody uses any more.
+        for (auto it = selections_.begin(); it != selections_.end();) {
+            it = it->second.expired() ? selections_.erase(it) : std::next(it);
+        }
+        std::shared_ptr<FieldSelection> selection = selections_[fields].lock();
+        if (!selection) {
+            selection = std::make_shared<FieldSelection>(fields);
+            selections_[fields] = selection;
+        }
+        return selection;
+    }
+
+private:
+    static bool glob(const char* p, const char* s) {
+        const char* star = nullptr;
+        const char* resume = nullptr;
+        while (*s) {
+            if (*p == '*') {
+                star = p++;
+                resume = s;
+            } else if (*p == *s) {
+                p++;
+                s++;
+            } else if (star) {
+                p = star + 1;
+                s = ++resume;
+            } else {
+                return false;
+            }
+        }
+        while (*p == '*') p++;
+        return *p == '\0';
+    }
+
+    std::mutex mutex_;
+    std::vector<std::string> names_;
+    std::map<std::vector<uint16_t>, std::weak_ptr<FieldSelection>> selections_;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Fixed-capacity columnar ring of past samples: one array of timestamps and
+// one array per metric. A single writer (the sampler) appends; any number of
+// readers query without taking a lock.
+class MetricHistory {
+public:
+    MetricHistory(size_t capacity, std::vector<std::string> columns)
+        : capacity_(capacity < 2 * ReadMargin ? 2 * ReadMargin : capacity),
+          names_(std::move(columns)),
+          timestamps_(new std::atomic<int64_t>[capacity_]) {
+        for (size_t c = 0; c < names_.size(); c++) {
+            columns_.emplace_back(new std::atomic<double>[capacity_]);
+        }
+    }
+
+    const std::vector<std::string>& columns() const { return names_; }
+    size_t capacity() const { return capacity_; }
+
+    // Appends one sample; `values` holds one entry per column. Writer only.
+    void append(int64_t timestampMs, const double* values) {
+        uint64_t n = head_.load(std::memory_order_relaxed);
+        size_t slot = n % capacity_;
+        timestamps_[slot].store(timestampMs, std::memory_order_relaxed);
+        for (size_t c = 0; c < columns_.size(); c++) {
+            columns_[c][slot].store(values[c], std::memory_order_relaxed);
+        }
+        head_.store(n + 1, std::memory_order_release);
+    }
+
+    // Averages of every column over [from, to] in buckets of `stepMs`.
+    // Buckets without samples are omitted.
+    struct Series {
+        std::vector<int64_t> timestamps;
+        std::vector<std::vector<double>> values; // [column][bucket]
+    };
+
+    Series query(int64_t from, int64_t to, int64_t stepMs) const {
+        if (stepMs <= 0) stepMs = 1;
+
+        // Retry if the writer lapped the oldest slot read. Queries are far
+        // shorter than a sample period, so this is rare.
+        Series out;
+        for (int attempt = 0; attempt < 4; attempt++) {
+            if (scan(from, to, stepMs, out)) break;
+        }
+        return out;
+    }
+
+private:
+    // Slots at the old end of the ring that readers skip, so the writer can
+    // advance while a query is running without overwriting what it reads.
+    static constexpr size_t ReadMargin = 16;
+
+    bool scan(int64_t from, int64_t to, int64_t stepMs, Series& out) const {
+        out.timestamps.clear();
+        out.values.assign(columns_.size(), {});
+
+        uint64_t end = head_.load(std::memory_order_acquire);
+        uint64_t begin = end > capacity_ - ReadMargin ? end - (capacity_ - ReadMargin) : 0;
+
+        // Timestamps are appended in order, so binary search the start.
+        uint64_t lo = begin, hi = end;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (timestampAt(mid) < from) lo = mid + 1;
+            else hi = mid;
+        }
+
+        std::vector<double> sums(columns_.size());
+        size_t count = 0;
+        int64_t bucket = 0;
+
+        auto emit = [&] {
+            if (count == 0) return;
+            out.timestamps.push_back(bucket);
+            for (size_t c = 0; c < columns_.size(); c++) {
+                out.values[c].push_back(sums[c] / count);
+                sums[c] = 0;
+            }
+            count = 0;
+        };
+
+        for (uint64_t i = lo; i < end; i++) {
+            int64_t ts = timestampAt(i);
+            if (ts > to) break;
+
+            int64_t b = from + (ts - from) / stepMs * stepMs;
+            if (count > 0 && b != bucket) emit();
+            bucket = b;
+
+            size_t slot = i % capacity_;
+            for (size_t c = 0; c < columns_.size(); c++) {
+                sums[c] += columns_[c][slot].load(std::memory_order_relaxed);
+            }
+            count++;
+        }
+        emit();
+
+        // Everything read must still be inside the ring.
+        uint64_t after = head_.load(std::memory_order_acquire);
+        return after < lo + capacity_;
+    }
+
+    int64_t timestampAt(uint64_t i) const {
+        return timestamps_[i % capacity_].load(std::memory_order_relaxed);
+    }
+
+    size_t capacity_;
+    std::vector<std::string> names_;
+    std::unique_ptr<std::atomic<int64_t>[]> timestamps_;
+    std::vector<std::unique_ptr<std::atomic<double>[]>> columns_;
+    std::atomic<uint64_t> head_{0};
+};
@@ -1,16 +1,31 @@
+// Thousands of stream subscribers reconnect at once after a restart;
+// httplib's default backlog of 5 would leave most of them in SYN retries.
+#define CPPHTTPLIB_LISTEN_BACKLOG SOMAXCONN
 #include "httplib.h"
 #include "nlohmann/json.hpp"
+#include "sampler.h"
+#include "counters.h"
+#include "bin_codec.h"
+#include "history.h"
+#include "rollup.h"
+#include "alerts.h"
+#include "prometheus.h"
+#include "field_select.h"
 
 using json = nlohmann::json;
 
-double getCPU();
-double getCPUProcess();
-double getTotalPhysicalMemory();
-double getUsedPhysicalMemory();
-double getProcessPhysicalMemory();
-double getTotalVirtualMemory();
-double getUsedVirtualMemory();
-double getProcessVirtualMemory();
+bool readCpuCounters(CpuCounters& c, CoreTimes& cores);
+bool readMemory(MemoryStats& m);
+bool getProcessMemory(double& physical, double& virtualMem);
+bool readTopProcesses(size_t n, ProcessRanking& byCpu, ProcessRanking& byRss, double& scanMs);
+bool readDisks(DiskStats& disks);
+bool readNetwork(NetStats& net);
+std::shared_ptr<const TcpSummary> latestTcpSummary();
+bool readProtocols(ProtocolRates& rates);
+bool readCgroups(CgroupStats& cgroups);
+bool readContainer(ContainerStats& container, double hostMemory);
+bool readPressure(PressureStats& pressure);
+bool startPressureTriggers(MetricsHub& hub);
 
 #ifdef _WIN32
 
@@ -20,101 +35,102 @@ double getProcessVirtualMemory();
 #include "psapi.h"
 
 
-static PDH_HQUERY cpuQuery;
-static PDH_HCOUNTER cpuTotal;
-
-static ULARGE_INTEGER lastCPU, lastSysCPU, lastUserCPU;
 static int numProcessors;
 static HANDLE self;
 
-void init(){
-    PdhOpenQuery(NULL, NULL, &cpuQuery);
-    PdhAddEnglishCounter(cpuQuery, L"\\Processor(_Total)\\% Processor Time", NULL, &cpuTotal);
-    PdhCollectQueryData(cpuQuery);
+static uint64_t fileTimeToU64(const FILETIME& ft) {
+    ULARGE_INTEGER v;
+    memcpy(&v, &ft, sizeof(FILETIME));
+    return v.QuadPart;
+}
 
+void init(){
     SYSTEM_INFO sysInfo;
-    FILETIME ftime, fsys, fuser;
-
     GetSystemInfo(&sysInfo);
     numProcessors = sysInfo.dwNumberOfProcessors;
 
-    GetSystemTimeAsFileTime(&ftime);
-    memcpy(&lastCPU, &ftime, sizeof(FILETIME));
-
     self = GetCurrentProcess();
-    GetProcessTimes(self, &ftime, &ftime, &fsys, &fuser);
-    memcpy(&lastSysCPU, &fsys, sizeof(FILETIME));
-    memcpy(&lastUserCPU, &fuser, sizeof(FILETIME));
 }
 
 
-MEMORYSTATUSEX memInfo;
-memInfo.dwLength = sizeof(MEMORYSTATUSEX);
-GlobalMemoryStatusEx(&memInfo);
+bool readMemory(MemoryStats& m) {
+    MEMORYSTATUSEX memInfo;
+    memInfo.dwLength = sizeof(MEMORYSTATUSEX);
+    if (!GlobalMemoryStatusEx(&memInfo)) return false;
 
-double getTotalVirtualMemory() {
-    DWORDLONG totalVirtualMem = memInfo.ullTotalPageFile;
-    return (double)totalVirtualMem;
+    m.total = (double)memInfo.ullTotalPhys;
+    m.used = (double)(memInfo.ullTotalPhys - memInfo.ullAvailPhys);
+    m.available = (double)memInfo.ullAvailPhys;
+    m.totalVirtual = (double)memInfo.ullTotalPageFile;
+    m.usedVirtual = (double)(memInfo.ullTotalPageFile - memInfo.ullAvailPageFile);
+    return true;
 }
 
-double getUsedVirtualMemory() {
-    DWORDLONG virtualMemUsed = memInfo.ullTotalPageFile - memInfo.ullAvailPageFile;
-    return (double)virtualMemUsed;
+bool getProcessMemory(double& physical, double& virtualMem) {
+    PROCESS_MEMORY_COUNTERS_EX pmc;
+    if (!GetProcessMemoryInfo(self, (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc))) return false;
+    physical = (double)pmc.WorkingSetSize;
+    virtualMem = (double)pmc.PrivateUsage;
+    return true;
 }
 
-double getProcessVirtualMemory() {
-    PROCESS_MEMORY_COUNTERS_EX pmc;
-    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc));
-    SIZE_T virtualMemUsedByMe = pmc.PrivateUsage;
-    return (double)virtualMemUsedByMe;
+// The process table is only collected on Linux.
+bool readTopProcesses(size_t, ProcessRanking&, ProcessRanking&, double&) {
+    return false;
 }
 
-double getTotalPhysicalMemory() {
-    DWORDLONG totalPhysMem = memInfo.ullTotalPhys;
-    return (double)totalPhysMem;
+bool readDisks(DiskStats&) {
+    return false;
 }
 
-double getUsedPhysicalMemory() {
-    DWORDLONG physMemUsed = memInfo.ullTotalPhys - memInfo.ullAvailPhys;
-    return (double)physMemUsed;
+bool readNetwork(NetStats&) {
+    return false;
 }
 
-double getProcessVirtualMemory() {
-    PROCESS_MEMORY_COUNTERS_EX pmc;
-    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc));
-    SIZE_T physMemUsedByMe = pmc.WorkingSetSize;
-    return (double)physMemUsedByMe;
+std::shared_ptr<const TcpSummary> latestTcpSummary() {
+    return nullptr;
+}
+
+bool readProtocols(ProtocolRates&) {
+    return false;
+}
+
+bool readCgroups(CgroupStats&) {
+    return false;
 }
 
+bool readContainer(ContainerStats&, double) {
+    return false;
+}
 
-double getCPU(){
-    PDH_FMT_COUNTERVALUE counterVal;
+bool readPressure(PressureStats&) {
+    return false;
+}
 
-    PdhCollectQueryData(cpuQuery);
-    PdhGetFormattedCounterValue(cpuTotal, PDH_FMT_DOUBLE, NULL, &counterVal);
-    return counterVal.doubleValue;
+bool startPressureTriggers(MetricsHub&) {
+    return false;
 }
 
-double getCPUProcess() {
-    FILETIME ftime, fsys, fuser;
-    ULARGE_INTEGER now, sys, user;
-    double percent;
 
-    GetSystemTimeAsFileTime(&ftime);
-    memcpy(&now, &ftime, sizeof(FILETIME));
+bool readCpuCounters(CpuCounters& c, CoreTimes& cores) {
+    FILETIME fidle, fkernel, fuser, ftime, fsys, fprocUser;
 
-    GetProcessTimes(self, &ftime, &ftime, &fsys, &fuser);
-    memcpy(&sys, &fsys, sizeof(FILETIME));
-    memcpy(&user, &fuser, sizeof(FILETIME));
-    percent = (sys.QuadPart - lastSysCPU.QuadPart) +
-        (user.QuadPart - lastUserCPU.QuadPart);
-    percent /= (now.QuadPart - lastCPU.QuadPart);
-    percent /= numProcessors;
-    lastCPU = now;
-    lastUserCPU = user;
-    lastSysCPU = sys;
+    if (!GetSystemTimes(&fidle, &fkernel, &fuser)) return false;
+    GetSystemTimeAsFileTime(&ftime);
+    GetProcessTimes(self, &ftime, &ftime, &fsys, &fprocUser);
+    GetSystemTimeAsFileTime(&ftime);
 
-    return percent * 100;
+    c.taken = std::chrono::steady_clock::now();
+    c.states[CpuIdle] = fileTimeToU64(fidle);
+    // Kernel time includes idle time.
+    c.states[CpuSystem] = fileTimeToU64(fkernel) - c.states[CpuIdle];
+    c.states[CpuUser] = fileTimeToU64(fuser);
+    // Per-core times are not collected on Windows.
+    cores.cores = 0;
+    c.procSys = fileTimeToU64(fsys);
+    c.procUser = fileTimeToU64(fprocUser);
+    c.wall = fileTimeToU64(ftime);
+    return true;
 }
 
 
@@ -128,279 +144,939 @@ double getCPUProcess() {
 #include "string.h"
 
 #include "sys/times.h"
+#include "sys/resource.h"
+
+#include "sse_server.h"
+#include "proc_reader.h"
+#include "cpu_stats.h"
+#include "segment_store.h"
+#include "process_table.h"
+#include "disk_stats.h"
+#include "net_stats.h"
+#include "sock_diag.h"
+#include "net_protocol.h"
+#include "cgroups.h"
+#include "container_limits.h"
+#include "pressure.h"
 
-struct sysinfo memInfo;
-static unsigned long long lastTotalUser, lastTotalUserLow, lastTotalSys, lastTotalIdle;
-
-static clock_t lastCPU, lastSysCPU, lastUserCPU;
 static int numProcessors;
 
-int parseLine(char* line){
-    int i = strlen(line);
-    const char* p = line;
-    while (*p <'0' || *p > '9') p++;
-    line[i-3] = '\0';
-    i = atoi(p);
-    return i;
+// Kept open for the lifetime of the process and re-read with pread().
+static ProcStatReader procStat;
+static ProcFile procSelfStatus("/proc/self/status");
+static ProcFile procMeminfo("/proc/meminfo");
+static ProcessTable processTable;
+static TaskstatsClient taskstats;
+static DiskStatsReader diskStats;
+static NetDevReader netDev;
+static TcpStateCollector tcpStates;
+static ProtocolCounters protocolCounters;
+static CgroupTree cgroupTree;
+static ContainerLimits containerLimits;
+static PressureReader pressureReader;
+static PressureTriggers pressureTriggers;
+
+// Root of the cgroup v2 hierarchy and how many levels below it to stream,
+// from MONITOR_CGROUP_ROOT and MONITOR_CGROUP_DEPTH. The monitor's own
+// cgroup is looked up under the same root for the container figures.
+static void openCgroups() {
+    const char* root = getenv("MONITOR_CGROUP_ROOT");
+    const char* depth = getenv("MONITOR_CGROUP_DEPTH");
+    cgroupTree.open(root ? root : "/sys/fs/cgroup", depth ? atoi(depth) : 3);
+    containerLimits.open(root ? root : "/sys/fs/cgroup");
 }
 
-void init() {
-    FILE* file1 = fopen("/proc/stat", "r");
-    if (!file1) return;
-
-    if (fscanf(file1, "cpu %llu %llu %llu %llu",
-               &lastTotalUser,
-               &lastTotalUserLow,
-               &lastTotalSys,
-               &lastTotalIdle) != 4) {
-        fclose(file1);
-        return;
-    }
+// Interval of the TCP socket dump, from MONITOR_TCP_INTERVAL_MS.
+static std::chrono::milliseconds tcpInterval() {
+    const char* env = getenv("MONITOR_TCP_INTERVAL_MS");
+    long ms = env ? atol(env) : 0;
+    return std::chrono::milliseconds(ms > 0 ? ms : 5000);
+}
 
-    fclose(file1);
+// Threads reading /proc/[pid] each tick, from MONITOR_SCAN_THREADS. Defaults
+// to up to 4, as stat reads contend on kernel locks beyond that.
+static size_t scanThreads() {
+    const char* env = getenv("MONITOR_SCAN_THREADS");
+    long threads = env ? atol(env) : 0;
+    if (threads > 0) return (size_t)threads;
+    return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+}
 
-    FILE* file2;
-    struct tms timeSample;
+void init() {
+    FILE* file;
     char line[128];
 
-    lastCPU = times(&timeSample);
-    lastSysCPU = timeSample.tms_stime;
-    lastUserCPU = timeSample.tms_utime;
+    // Every stream subscriber holds a socket; allow as many as the hard limit.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 
-    file2 = fopen("/proc/cpuinfo", "r");
+    file = fopen("/proc/cpuinfo", "r");
     numProcessors = 0;
-    while(fgets(line, 128, file2) != NULL){
+    if (!file) return;
+    while(fgets(line, 128, file) != NULL){
         if (strncmp(line, "processor", 9) == 0) numProcessors++;
     }
-    fclose(file2);
+    fclose(file);
+
+    procStat.open();
+    processTable.open(scanThreads());
+    taskstats.open();
+    diskStats.open();
+    netDev.open();
+    tcpStates.start(tcpInterval(), 10);
+    protocolCounters.open();
+    openCgroups();
+    pressureReader.open();
 }
 
-double getTotalVirtualMemory() {
-    sysinfo (&memInfo);
-    long long totalVirtualMem = memInfo.totalram;
-    totalVirtualMem += memInfo.totalswap;
-    totalVirtualMem *= memInfo.mem_unit;
+// Falls back to sysinfo() when /proc/meminfo cannot be read; "used" then
+// counts page cache as used, as there is no MemAvailable to go by.
+static bool readMemorySysinfo(MemoryStats& m) {
+    struct sysinfo memInfo;
+    if (sysinfo(&memInfo) != 0) return false;
+
+    double unit = memInfo.mem_unit;
+    m.total = memInfo.totalram * unit;
+    m.used = (memInfo.totalram - memInfo.freeram) * unit;
+    m.available = memInfo.freeram * unit;
+    m.buffers = memInfo.bufferram * unit;
+    m.totalVirtual = (memInfo.totalram + memInfo.totalswap) * unit;
+    m.usedVirtual = m.used + (memInfo.totalswap - memInfo.freeswap) * unit;
+    return true;
+}
 
-    return (double)totalVirtualMem;
+// Reads every memory figure with one pass over /proc/meminfo. "Used" is
+// total minus MemAvailable, so reclaimable cache does not count as pressure.
+bool readMemory(MemoryStats& m) {
+    enum { Total, Free, Available, Buffers, Cached, SwapTotal, SwapFree,
+           Dirty, Writeback, Slab, FieldCount };
+    static const struct { const char* key; size_t len; } fields[FieldCount] = {
+        {"MemTotal:", 9}, {"MemFree:", 8}, {"MemAvailable:", 13},
+        {"Buffers:", 8}, {"Cached:", 7}, {"SwapTotal:", 10}, {"SwapFree:", 9},
+        {"Dirty:", 6}, {"Writeback:", 10}, {"Slab:", 5},
+    };
+
+    char buf[8192];
+    ssize_t len = procMeminfo.read(buf, sizeof(buf));
+    if (len <= 0) return readMemorySysinfo(m);
+
+    uint64_t kb[FieldCount] = {};
+    bool seen[FieldCount] = {};
+    ProcTokenizer tok(buf, (size_t)len);
+    do {
+        for (int i = 0; i < FieldCount; i++) {
+            if (!seen[i] && tok.startsWith(fields[i].key, fields[i].len)) {
+                seen[i] = tok.number(kb[i]);
+                break;
+            }
+        }
+    } while (tok.nextLine());
+
+    if (!seen[Total] || !seen[Available]) return readMemorySysinfo(m);
+
+    m.total = kb[Total] * 1024.0;
+    m.available = kb[Available] * 1024.0;
+    m.used = m.total - m.available;
+    m.buffers = kb[Buffers] * 1024.0;
+    m.cached = kb[Cached] * 1024.0;
+    m.slab = kb[Slab] * 1024.0;
+    m.dirty = kb[Dirty] * 1024.0;
+    m.writeback = kb[Writeback] * 1024.0;
+    m.totalVirtual = (kb[Total] + kb[SwapTotal]) * 1024.0;
+    m.usedVirtual = m.used + (kb[SwapTotal] - kb[SwapFree]) * 1024.0;
+    return true;
 }
 
-double getUsedVirtualMemory() {
-    sysinfo (&memInfo);
-    long long virtualMemUsed = memInfo.totalram - memInfo.freeram;
-    virtualMemUsed += memInfo.totalswap - memInfo.freeswap;
-    virtualMemUsed *= memInfo.mem_unit;
+// Reads VmRSS and VmSize (in KB) with a single pass over /proc/self/status.
+bool getProcessMemory(double& physical, double& virtualMem) {
+    char buf[4096];
+    ssize_t len = procSelfStatus.read(buf, sizeof(buf));
+    if (len <= 0) return false;
+
+    uint64_t size = 0, rss = 0;
+    ProcTokenizer tok(buf, (size_t)len);
+    if (!tok.findLine("VmSize:") || !tok.number(size)) return false;
+    if (!tok.findLine("VmRSS:") || !tok.number(rss)) return false;
 
-    return (double)virtualMemUsed;
+    physical = (double)rss;
+    virtualMem = (double)size;
+    return true;
 }
 
-double getProcessVirtualMemory(){
-    FILE* file = fopen("/proc/self/status", "r");
-    int result = -1;
-    char line[128];
+static void rank(const std::vector<const ProcessTable::Process*>& top, ProcessRanking& out) {
+    for (const ProcessTable::Process* p : top) {
+        out.pid.push_back(p->pid);
+        out.name.push_back(p->name);
+        out.cpu.push_back(p->cpu);
+        out.rss.push_back(p->rss);
+        out.cpuDelay.push_back(p->cpuDelay);
+        out.ioDelay.push_back(p->ioDelay);
+        out.swapDelay.push_back(p->swapDelay);
+        out.reclaimDelay.push_back(p->reclaimDelay);
+    }
+}
 
-    while (fgets(line, 128, file) != NULL){
-        if (strncmp(line, "VmSize:", 7) == 0){
-            result = parseLine(line);
-            break;
+// Scans every process and keeps the `n` busiest and the `n` largest, with
+// delay accounting for those only, fetched in one taskstats batch.
+bool readTopProcesses(size_t n, ProcessRanking& byCpu, ProcessRanking& byRss, double& scanMs) {
+    if (!processTable.scan()) return false;
+    scanMs = processTable.scanMs();
+
+    static std::vector<const ProcessTable::Process*> topCpu, topRss;
+    static std::vector<uint32_t> watched;
+    static std::vector<TaskDelays> delays;
+    processTable.top(n, [](const ProcessTable::Process& p) { return p.cpu; }, topCpu);
+    processTable.top(n, [](const ProcessTable::Process& p) { return p.rss; }, topRss);
+
+    if (taskstats.isOpen()) {
+        watched.clear();
+        for (auto* p : topCpu) watched.push_back(p->pid);
+        for (auto* p : topRss) {
+            if (std::find(watched.begin(), watched.end(), p->pid) == watched.end()) {
+                watched.push_back(p->pid);
+            }
         }
+        if (taskstats.query(watched, delays)) processTable.setDelays(delays);
     }
-    fclose(file);
-    return (double)result;  
+
+    rank(topCpu, byCpu);
+    rank(topRss, byRss);
+    return true;
 }
 
-double getTotalPhysicalMemory() {
-    sysinfo (&memInfo);
-    long long totalPhysMem = memInfo.totalram;
-    totalPhysMem *= memInfo.mem_unit;
+bool readDisks(DiskStats& disks) {
+    return diskStats.read(disks);
+}
 
-    return (double)totalPhysMem;
+bool readNetwork(NetStats& net) {
+    return netDev.read(net);
 }
 
-double getUsedPhysicalMemory() {
-    sysinfo (&memInfo);
-    long long physMemUsed = memInfo.totalram - memInfo.freeram;
-    physMemUsed *= memInfo.mem_unit;
+std::shared_ptr<const TcpSummary> latestTcpSummary() {
+    return tcpStates.latest();
+}
 
-    return (double)physMemUsed;
+bool readProtocols(ProtocolRates& rates) {
+    return protocolCounters.read(rates);
 }
 
-double getProcessPhysicalMemory(){
-    FILE* file = fopen("/proc/self/status", "r");
-    double result = -1;
-    char line[128];
+bool readCgroups(CgroupStats& cgroups) {
+    return cgroupTree.read(cgroups);
+}
+
+bool readContainer(ContainerStats& container, double hostMemory) {
+    return containerLimits.read(container, numProcessors, hostMemory);
+}
+
+bool readPressure(PressureStats& pressure) {
+    return pressureReader.read(pressure);
+}
 
-    while (fgets(line, 128, file) != NULL){
-        if (strncmp(line, "VmRSS:", 6) == 0){
-            result = parseLine(line);
-            break;
+// Registers the PSI triggers in MONITOR_PSI_TRIGGERS, a ';' separated list
+// of "resource some|full stall_us window_us", and publishes an
+// "event: pressure" frame to stream subscribers each time one fires.
+bool startPressureTriggers(MetricsHub& hub) {
+    const char* env = getenv("MONITOR_PSI_TRIGGERS");
+    std::string specs = env ? env
+        : "cpu some 150000 1000000;memory some 150000 1000000;io some 150000 1000000";
+
+    size_t start = 0;
+    while (start < specs.size()) {
+        size_t end = specs.find(';', start);
+        if (end == std::string::npos) end = specs.size();
+        char resource[16], kind[8];
+        unsigned long long stall, window;
+        std::string spec = specs.substr(start, end - start);
+        if (sscanf(spec.c_str(), "%15s %7s %llu %llu", resource, kind, &stall, &window) != 4 ||
+            !pressureTriggers.add(resource, kind, stall, window)) {
+            fprintf(stderr, "cannot register PSI trigger \"%s\"\n", spec.c_str());
         }
+        start = end + 1;
     }
-    fclose(file);
-    return (double)result;  
+
+    return pressureTriggers.start([&hub](const PressureTriggers::Trigger& t, double avg10) {
+        json event = {
+            {"resource", t.resource},
+            {"kind", t.kind},
+            {"stall_us", t.stallUs},
+            {"window_us", t.windowUs},
+            {"avg10", avg10},
+            {"timestamp", std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()},
+        };
+        hub.publishEvent("event: pressure\ndata: " + event.dump() + "\n\n");
+    });
 }
 
-double getCPU() {
-    FILE* file = fopen("/proc/stat", "r");
-    if (!file) return -1.0;
+bool readCpuCounters(CpuCounters& c, CoreTimes& cores) {
+    if (!procStat.read(c.states, cores)) return false;
 
-    unsigned long long totalUser, totalUserLow, totalSys, totalIdle;
+    struct tms timeSample;
+    clock_t now = times(&timeSample);
+    if (now == (clock_t)-1) return false;
+
+    c.taken = std::chrono::steady_clock::now();
+    c.procUser = timeSample.tms_utime;
+    c.procSys = timeSample.tms_stime;
+    c.wall = (uint64_t)now;
+    return true;
+}
+
+
+#endif
 
-    if (fscanf(file, "cpu %llu %llu %llu %llu",
-               &totalUser,
-               &totalUserLow,
-               &totalSys,
-               &totalIdle) != 4) {
-        fclose(file);
-        return -1.0;
+
+static const std::chrono::milliseconds samplePeriod(500);
+
+// Collectors that can run on their own interval, from
+// MONITOR_COLLECTOR_INTERVALS ("processes=2s,cgroups=1s"). Unlisted ones run
+// for every snapshot; CPU and memory always do.
+enum Collector {
+    CollectProcesses, CollectDisks, CollectNetwork, CollectProtocols,
+    CollectCgroups, CollectContainer, CollectPressure, CollectorCount
+};
+
+static const char* const collectorNames[CollectorCount] = {
+    "processes", "disks", "network", "protocols", "cgroups", "container", "pressure",
+};
+
+static std::vector<std::chrono::milliseconds> collectorIntervals() {
+    std::vector<std::chrono::milliseconds> intervals(CollectorCount, std::chrono::milliseconds(0));
+    const char* env = getenv("MONITOR_COLLECTOR_INTERVALS");
+    std::string specs = env ? env : "";
+    for (size_t start = 0; start < specs.size();) {
+        size_t end = std::min(specs.find(',', start), specs.size());
+        std::string spec = specs.substr(start, end - start);
+        size_t eq = spec.find('=');
+        int c = 0;
+        while (c < CollectorCount && (eq == std::string::npos || spec.compare(0, eq, collectorNames[c]) != 0)) c++;
+        std::chrono::milliseconds interval = c < CollectorCount
+            ? Sampler::parseInterval(spec.substr(eq + 1), std::chrono::milliseconds(0))
+            : std::chrono::milliseconds(0);
+        if (interval.count() > 0) intervals[c] = interval;
+        else fprintf(stderr, "bad collector interval \"%s\"\n", spec.c_str());
+        start = end + 1;
     }
+    return intervals;
+}
 
-    fclose(file);
+// Length of the top-processes lists in every snapshot.
+static const size_t topProcesses = 10;
 
-    double percent;
-    unsigned long long total;
+// Raw CPU readings from every tick; utilisation is computed from it for
+// whatever window a consumer asks for.
+static CounterRing cpuRing;
 
-    if (totalUser < lastTotalUser ||
-        totalUserLow < lastTotalUserLow ||
-        totalSys < lastTotalSys ||
-        totalIdle < lastTotalIdle) {
-        percent = -1.0;
-    } else {
-        total = (totalUser - lastTotalUser)
-              + (totalUserLow - lastTotalUserLow)
-              + (totalSys - lastTotalSys);
+// Per-core counters from the previous and current tick, swapped every tick.
+// Only touched by the sampler thread.
+static CoreTimes coreTimes[2];
+static int coreCurrent = 0;
+static CoreUtilisation coreUtilisation;
+
+static bool sampleCpu() {
+    CpuCounters counters;
+    CoreTimes& cores = coreTimes[coreCurrent];
+    if (!readCpuCounters(counters, cores)) return false;
+
+    cpuRing.push(counters);
+    coreCurrent ^= 1;
+    return true;
+}
+
+// Calls out.scalar(name, value, decimals) or out.array(name, values, decimals)
+// for every metric in a snapshot, in a stable order. Decimals is the
+// fixed-point precision used by the binary stream.
+template <class Out>
+void visitMetrics(const Snapshot& snap, Out& out) {
+    out.scalar("cpu", snap.cpu, 2);
+    out.scalar("cpu_process", snap.cpuProcess, 2);
+    out.scalar("cpu_iowait", snap.cpuIoWait, 2);
+    out.scalar("cpu_steal", snap.cpuSteal, 2);
+    out.array("cpu_cores", snap.coreBusy, 2);
+    out.array("cpu_cores_steal", snap.coreSteal, 2);
+    out.scalar("total_ram", snap.memory.total, 0);
+    out.scalar("used_ram", snap.memory.used, 0);
+    out.scalar("available_ram", snap.memory.available, 0);
+    out.scalar("cached_ram", snap.memory.cached, 0);
+    out.scalar("buffers_ram", snap.memory.buffers, 0);
+    out.scalar("slab_ram", snap.memory.slab, 0);
+    out.scalar("dirty_ram", snap.memory.dirty, 0);
+    out.scalar("writeback_ram", snap.memory.writeback, 0);
+    out.scalar("process_ram", snap.processRam, 0);
+    out.scalar("total_virtual_ram", snap.memory.totalVirtual, 0);
+    out.scalar("used_virtual_ram", snap.memory.usedVirtual, 0);
+    out.scalar("process_virtual_ram", snap.processVirtualRam, 0);
+    out.array("disk_read_iops", snap.disks.readIops, 1);
+    out.array("disk_write_iops", snap.disks.writeIops, 1);
+    out.array("disk_read_bytes", snap.disks.readBytes, 0);
+    out.array("disk_write_bytes", snap.disks.writeBytes, 0);
+    out.array("disk_await_ms", snap.disks.awaitMs, 2);
+    out.array("disk_util", snap.disks.util, 1);
+    out.array("net_rx_bytes", snap.net.rxBytes, 0);
+    out.array("net_tx_bytes", snap.net.txBytes, 0);
+    out.array("net_rx_packets", snap.net.rxPackets, 1);
+    out.array("net_tx_packets", snap.net.txPackets, 1);
+    out.array("net_rx_errors", snap.net.rxErrors, 1);
+    out.array("net_tx_errors", snap.net.txErrors, 1);
+    out.array("net_rx_drops", snap.net.rxDrops, 1);
+    out.array("net_tx_drops", snap.net.txDrops, 1);
+    static const TcpSummary noTcp;
+    const TcpSummary& tcp = snap.tcp ? *snap.tcp : noTcp;
+    out.scalar("tcp_established", tcp.states[1], 0);
+    out.scalar("tcp_syn_sent", tcp.states[2], 0);
+    out.scalar("tcp_syn_recv", tcp.states[3], 0);
+    out.scalar("tcp_fin_wait1", tcp.states[4], 0);
+    out.scalar("tcp_fin_wait2", tcp.states[5], 0);
+    out.scalar("tcp_time_wait", tcp.states[6], 0);
+    out.scalar("tcp_close", tcp.states[7], 0);
+    out.scalar("tcp_close_wait", tcp.states[8], 0);
+    out.scalar("tcp_last_ack", tcp.states[9], 0);
+    out.scalar("tcp_listen", tcp.states[10], 0);
+    out.scalar("tcp_closing", tcp.states[11], 0);
+    out.scalar("tcp_listen_full", tcp.listenersFull, 0);
+    out.scalar("tcp_dump_ms", tcp.dumpMs, 2);
+    out.array("tcp_listen_port", tcp.listenPort, 0);
+    out.array("tcp_listen_queue", tcp.listenQueue, 0);
+    out.array("tcp_listen_backlog", tcp.listenBacklog, 0);
+    out.scalar("tcp_out_segs", snap.protocols.tcpOutSegs, 1);
+    out.scalar("tcp_retrans", snap.protocols.tcpRetrans, 1);
+    out.scalar("tcp_retrans_percent", snap.protocols.tcpRetransPercent, 2);
+    out.scalar("tcp_in_errors", snap.protocols.tcpInErrors, 1);
+    out.scalar("tcp_out_resets", snap.protocols.tcpOutResets, 1);
+    out.scalar("tcp_estab_resets", snap.protocols.tcpEstabResets, 1);
+    out.scalar("tcp_attempt_fails", snap.protocols.tcpAttemptFails, 1);
+    out.scalar("tcp_listen_overflows", snap.protocols.tcpListenOverflows, 1);
+    out.scalar("tcp_listen_drops", snap.protocols.tcpListenDrops, 1);
+    out.scalar("tcp_timeouts", snap.protocols.tcpTimeouts, 1);
+    out.scalar("udp_in_datagrams", snap.protocols.udpInDatagrams, 1);
+    out.scalar("udp_in_errors", snap.protocols.udpInErrors, 1);
+    out.scalar("udp_rcvbuf_errors", snap.protocols.udpRcvbufErrors, 1);
+    out.scalar("udp_sndbuf_errors", snap.protocols.udpSndbufErrors, 1);
+    out.scalar("udp_no_ports", snap.protocols.udpNoPorts, 1);
+    out.scalar("container_cpu", snap.container.cpu, 2);
+    out.scalar("container_cpu_limit", snap.container.cpuLimit, 2);
+    out.scalar("container_throttled_ms", snap.container.throttledMs, 1);
+    out.scalar("container_throttled_periods", snap.container.throttledPeriods, 1);
+    out.scalar("container_total_ram", snap.container.memoryLimit, 0);
+    out.scalar("container_used_ram", snap.container.memoryUsed, 0);
+    out.scalar("psi_cpu_some", snap.pressure.cpuSome, 2);
+    out.scalar("psi_cpu_full", snap.pressure.cpuFull, 2);
+    out.scalar("psi_memory_some", snap.pressure.memorySome, 2);
+    out.scalar("psi_memory_full", snap.pressure.memoryFull, 2);
+    out.scalar("psi_io_some", snap.pressure.ioSome, 2);
+    out.scalar("psi_io_full", snap.pressure.ioFull, 2);
+    out.array("cgroup_cpu", snap.cgroups.cpu, 2);
+    out.array("cgroup_memory", snap.cgroups.memory, 0);
+    out.array("cgroup_memory_anon", snap.cgroups.memoryAnon, 0);
+    out.array("cgroup_memory_file", snap.cgroups.memoryFile, 0);
+    out.array("cgroup_io_read", snap.cgroups.ioRead, 0);
+    out.array("cgroup_io_write", snap.cgroups.ioWrite, 0);
+    out.array("cgroup_pids", snap.cgroups.pids, 0);
+    out.array("cgroup_cpu_pressure", snap.cgroups.cpuPressure, 2);
+    out.array("cgroup_memory_pressure", snap.cgroups.memoryPressure, 2);
+    out.array("cgroup_io_pressure", snap.cgroups.ioPressure, 2);
+    out.scalar("process_scan_ms", snap.processScanMs, 2);
+    out.array("top_cpu_pid", snap.topCpu.pid, 0);
+    out.array("top_cpu", snap.topCpu.cpu, 1);
+    out.array("top_cpu_delay_cpu", snap.topCpu.cpuDelay, 1);
+    out.array("top_cpu_delay_io", snap.topCpu.ioDelay, 1);
+    out.array("top_cpu_delay_swap", snap.topCpu.swapDelay, 1);
+    out.array("top_cpu_delay_reclaim", snap.topCpu.reclaimDelay, 1);
+    out.array("top_rss_pid", snap.topRss.pid, 0);
+    out.array("top_rss", snap.topRss.rss, 0);
+    out.array("top_rss_delay_cpu", snap.topRss.cpuDelay, 1);
+    out.array("top_rss_delay_io", snap.topRss.ioDelay, 1);
+    out.array("top_rss_delay_swap", snap.topRss.swapDelay, 1);
+    out.array("top_rss_delay_reclaim", snap.topRss.reclaimDelay, 1);
+}
+
+struct JsonWriter {
+    json& data;
+
+    void scalar(const char* name, double value, int) { data[name] = value; }
+
+    template <class T>
+    void array(const char* name, const std::vector<T>& values, int) { data[name] = values; }
+};
 
-        percent = (double)total;
-        total += (totalIdle - lastTotalIdle);
-        percent = (percent / total) * 100.0;
+// Collects the names, values and decimals of scalar metrics; arrays
+// (per-core rows) are not kept in history.
+struct ScalarCollector {
+    std::vector<std::string>* names;
+    std::vector<double>* values;
+    std::vector<int>* decimals = nullptr;
+
+    void scalar(const char* name, double value, int digits) {
+        if (names) names->push_back(name);
+        if (values) values->push_back(value);
+        if (decimals) decimals->push_back(digits);
     }
 
-    lastTotalUser = totalUser;
-    lastTotalUserLow = totalUserLow;
-    lastTotalSys = totalSys;
-    lastTotalIdle = totalIdle;
-
-    return (double)percent;
-}
-int i = 1;
-double getCPUProcess() {
-    // std::cout << "Start getCPUProcess" << std::endl; // Comment
-    // struct tms timeSample;
-    // std::cout << "timeSample stime:" << timeSample.tms_stime << std::endl; // Comment
-    // std::cout << "timeSample utime:" << timeSample.tms_utime << std::endl; // Comment
-    // clock_t now = times(&timeSample);
-    // std::cout << "now:" << now << std::endl; // Comment
-   
-
-    // if (now == (clock_t)-1) {
-    //     return -1.0;
-    //     std::cout << "Return -1.0 (1):" << std::endl; // Comment
-    // }
-
-    // if (lastCPU == 0) {
-    //     lastCPU = now;
-    //     lastSysCPU = timeSample.tms_stime;
-    //     lastUserCPU = timeSample.tms_utime;
-    //     return 0.0;
-    //     std::cout << "Return 0.0 (1):" << std::endl; // Comment
-    // }
-    // std::cout << "lastCPU: " << lastCPU << std::endl; // Comment
-    
-   
-
-    // double percent =
-    //     (timeSample.tms_stime - lastSysCPU) +
-    //     (timeSample.tms_utime - lastUserCPU);
-    // std::cout << "Percent: (1)" << percent << std::endl; // Comment
-    // percent /= (now - lastCPU);
-    // std::cout << "Percent: (2)" << percent << std::endl; // Comment
-    // percent /= numProcessors;
-    // std::cout << "Percent: (3)" << percent << std::endl; // Comment
-    // percent *= 100.0;
-    // std::cout << "Percent: (4)" << percent << std::endl; // Comment
-
-    // lastCPU = now;
-    // lastSysCPU = timeSample.tms_stime;
-    // lastUserCPU = timeSample.tms_utime;
-    // std::cout << "Percent: (5)" << percent << std::endl; // Comment
-    // return percent;
-
-    std::cout << "----------------------------" << std::endl; // Comment
-    std::cout << "Update: " << i << std::endl; // Comment
-    i++;
-    std::cout << "----------------------------" << std::endl; // Comment
-    std::cout << "Start getCPUProcess" << std::endl; // Comment
-    struct tms timeSample;
-    std::cout << "timeSample stime: " << timeSample.tms_stime << std::endl; // Comment
-    std::cout << "timeSample utime: " << timeSample.tms_utime << std::endl; // Comment
-    clock_t now;
-    std::cout << "Now: " << now << std::endl; // Comment
-    double percent;
-
-
-    now = times(&timeSample);
-    if (now <= lastCPU || timeSample.tms_stime < lastSysCPU ||
-        timeSample.tms_utime < lastUserCPU){
-        //Overflow detection. Just skip this value.
-        percent = -1.0;
-        std::cout << "Return -1.0 (1):" << std::endl; // Comment
+    template <class T>
+    void array(const char*, const std::vector<T>&, int) {}
+};
+
+// Keeps the previous tick's values to delta-encode against. Sampler thread only.
+static BinaryEncoder binaryEncoder;
+
+// Past samples for /metrics/history. Created in main() before sampling starts.
+static std::unique_ptr<MetricHistory> history;
+static std::unique_ptr<Rollups> rollups;
+#ifndef _WIN32
+// Compressed on-disk history, only when MONITOR_DATA_DIR is set.
+static std::unique_ptr<SegmentStore> segmentStore;
+#endif
+static int64_t startedMs;
+
+// Retention window of the in-memory history, from MONITOR_HISTORY_SECONDS.
+static std::chrono::seconds historyRetention() {
+    const char* env = getenv("MONITOR_HISTORY_SECONDS");
+    long seconds = env ? atol(env) : 0;
+    return std::chrono::seconds(seconds > 0 ? seconds : 3600);
+}
+
+// Threshold rules from MONITOR_ALERT_RULES, evaluated every history period.
+static AlertEngine alerts;
+static AlertInputs alertInputs; // sampler thread only
+
+// What the elements of each array metric are, for alert rule keys and
+// Prometheus labels.
+static std::vector<ArrayLabels> arrayLabels(const Snapshot& snap) {
+    return {
+        {"cpu_cores", "core", nullptr},
+        {"top_cpu", "process", &snap.topCpu.name, &snap.topCpu.pid},
+        {"top_rss", "process", &snap.topRss.name, &snap.topRss.pid},
+        {"disk_", "disk", &snap.disks.name},
+        {"net_", "interface", &snap.net.name},
+        {"tcp_listen_", "rank", nullptr},
+        {"cgroup_", "cgroup", &snap.cgroups.path},
+    };
+}
+
+static const char* alertStateName(AlertEngine::State state) {
+    switch (state) {
+        case AlertEngine::Pending: return "pending";
+        case AlertEngine::Firing: return "firing";
+        default: return "ok";
+    }
+}
+
+// Loads a JSON array of rules such as
+//   {"name": "cpu-high", "metric": "cpu", "op": ">", "threshold": 90,
+//    "clear": 80, "for": 30}
+// where "for" is in seconds, "op" defaults to ">" and "clear" to the
+// threshold. Elements of array metrics are picked with "key" (a disk,
+// interface, cgroup or process name) or "index". Bad rules are skipped.
+static void loadAlertRules() {
+    const char* path = getenv("MONITOR_ALERT_RULES");
+    if (!path) return;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "cannot open alert rules %s\n", path);
+        return;
+    }
+    json rules = json::parse(file, nullptr, false);
+    fclose(file);
+    if (!rules.is_array()) {
+        fprintf(stderr, "alert rules %s are not a JSON array\n", path);
+        return;
     }
-    else{
-        percent = (timeSample.tms_stime - lastSysCPU) +
-            (timeSample.tms_utime - lastUserCPU);
-            std::cout << "Percent: (1): " << percent << std::endl; // Comment
-        percent /= (now - lastCPU);
-        std::cout << "Percent (2): " << percent << std::endl; // Comment
-        percent /= numProcessors;
-        std::cout << "Percent (3): " << percent << std::endl; // Comment
-        percent *= 100;
-        std::cout << "Percent (4): " << percent << std::endl; // Comment
+
+    Snapshot empty;
+    AlertInputs schema;
+    visitMetrics(empty, schema);
+    for (const json& r : rules) {
+        if (!r.is_object()) continue;
+        AlertEngine::Rule rule;
+        rule.metric = r.value("metric", "");
+        rule.name = r.value("name", rule.metric);
+        rule.key = r.value("key", "");
+        rule.index = r.value("index", -1);
+        rule.op = r.value("op", ">");
+        rule.threshold = r.value("threshold", 0.0);
+        rule.clear = r.value("clear", rule.threshold);
+        rule.forMs = (int64_t)(r.value("for", 0.0) * 1000);
+
+        std::string error;
+        if (!alerts.add(rule, schema, arrayLabels(empty), error)) {
+            fprintf(stderr, "alert rule %s: %s\n", rule.name.c_str(), error.c_str());
+        }
     }
-    lastCPU = now;
-    lastSysCPU = timeSample.tms_stime;
-    lastUserCPU = timeSample.tms_utime;
-    std::cout << "Percent (5): " << percent << std::endl; // Comment
-    return percent;
 }
 
+// Publishes an "event: alert" frame for every rule that fired or resolved.
+static void evaluateAlerts(const Snapshot& snap, MetricsHub& hub) {
+    if (alerts.size() == 0 || !snap.historyDue) return;
+    static std::vector<AlertEngine::Transition> transitions;
+    transitions.clear();
+    alertInputs.clear();
+    visitMetrics(snap, alertInputs);
+    alerts.evaluate(alertInputs, arrayLabels(snap), snap.timestampMs, transitions);
+
+    for (const AlertEngine::Transition& t : transitions) {
+        const AlertEngine::Rule& rule = alerts.rule(t.rule);
+        json event = {
+            {"rule", rule.name},
+            {"metric", rule.metric},
+            {"key", rule.key},
+            {"state", t.state == AlertEngine::Firing ? "firing" : "resolved"},
+            {"value", t.value},
+            {"threshold", rule.threshold},
+            {"timestamp", snap.timestampMs},
+        };
+        hub.publishEvent("event: alert\ndata: " + event.dump() + "\n\n");
+    }
+}
 
+// Every field of the JSON stream.
+static json streamJson(const Snapshot& snap) {
+    json data = {{"status", "connected"}, {"timestamp", snap.timestampMs}};
+    JsonWriter writer{data};
+    visitMetrics(snap, writer);
+    // Names only go to the JSON stream; the binary format carries numbers.
+    data["top_cpu_name"] = snap.topCpu.name;
+    data["top_rss_name"] = snap.topRss.name;
+    data["disk_name"] = snap.disks.name;
+    data["net_name"] = snap.net.name;
+    data["cgroup_path"] = snap.cgroups.path;
+    return data;
+}
+
+// Resolves ?metrics= on /metrics/stream against the JSON stream's fields.
+static FieldSelector streamFields;
+
+// Fills one snapshot with every metric and serializes it once for all sinks.
+// Collectors that are not due copy their figures from `previous`.
+void collect(Snapshot& snap, const Snapshot* previous) {
+    if (sampleCpu()) {
+        // coreCurrent now points at the previous tick's counters.
+        CoreTimes& older = coreTimes[coreCurrent];
+        CoreTimes& newer = coreTimes[coreCurrent ^ 1];
+        coreUtilisation.compute(older, newer, snap.coreBusy, snap.coreSteal);
+    }
+
+    // CPU figures over the history period, and over each due interval for
+    // its subscribers.
+    CpuCounters older, newer;
+    if (cpuRing.window(samplePeriod, older, newer)) {
+        snap.cpu = cpuPercent(older, newer);
+        snap.cpuProcess = cpuProcessPercent(older, newer, numProcessors);
+        snap.cpuIoWait = cpuStatePercent(older, newer, CpuIoWait);
+        snap.cpuSteal = cpuStatePercent(older, newer, CpuSteal);
+    }
+    for (uint32_t interval : snap.intervals) {
+        if (!cpuRing.window(std::chrono::milliseconds(interval), older, newer)) break;
+        Snapshot::CpuWindow& w = snap.cpuWindows.emplace_back();
+        w.intervalMs = interval;
+        w.cpu = cpuPercent(older, newer);
+        w.cpuProcess = cpuProcessPercent(older, newer, numProcessors);
+        w.cpuIoWait = cpuStatePercent(older, newer, CpuIoWait);
+        w.cpuSteal = cpuStatePercent(older, newer, CpuSteal);
+    }
+    auto due = [&](Collector c) { return !previous || (snap.collectorsDue >> c & 1); };
+
+    readMemory(snap.memory);
+    if (due(CollectProcesses)) {
+        readTopProcesses(topProcesses, snap.topCpu, snap.topRss, snap.processScanMs);
+    } else {
+        snap.topCpu = previous->topCpu;
+        snap.topRss = previous->topRss;
+        snap.processScanMs = previous->processScanMs;
+    }
+    if (due(CollectDisks)) readDisks(snap.disks);
+    else snap.disks = previous->disks;
+    if (due(CollectNetwork)) readNetwork(snap.net);
+    else snap.net = previous->net;
+    snap.tcp = latestTcpSummary();
+    if (due(CollectProtocols)) readProtocols(snap.protocols);
+    else snap.protocols = previous->protocols;
+    if (due(CollectCgroups)) readCgroups(snap.cgroups);
+    else snap.cgroups = previous->cgroups;
+    if (due(CollectContainer)) readContainer(snap.container, snap.memory.total);
+    else snap.container = previous->container;
+    if (due(CollectPressure)) readPressure(snap.pressure);
+    else snap.pressure = previous->pressure;
+    if (!getProcessMemory(snap.processRam, snap.processVirtualRam)) {
+        snap.processRam = snap.processVirtualRam = -1;
+    }
+
+    // Each field is serialized once; the full frame and every ?metrics=
+    // selection are joined from the pieces. Each CPU window only
+    // serializes its own CPU fields.
+    json data = streamJson(snap);
+    snap.fieldEnds.push_back(0);
+    for (auto& field : data.items()) {
+        auto piece = [&](const json& value) { return '"' + field.key() + "\":" + value.dump(); };
+        snap.fields += piece(field.value());
+        snap.fieldEnds.push_back((uint32_t)snap.fields.size());
+
+        uint16_t index = (uint16_t)(snap.fieldEnds.size() - 2);
+        for (Snapshot::CpuWindow& w : snap.cpuWindows) {
+            const double* value = field.key() == "cpu" ? &w.cpu
+                : field.key() == "cpu_process" ? &w.cpuProcess
+                : field.key() == "cpu_iowait" ? &w.cpuIoWait
+                : field.key() == "cpu_steal" ? &w.cpuSteal : nullptr;
+            if (value) w.fields.emplace_back(index, piece(*value));
+        }
+    }
+    auto joinFrame = [&](std::string& out, const Snapshot::CpuWindow* w) {
+        out.reserve(snap.fields.size() + snap.fieldEnds.size() + 16);
+        out = "data: {";
+        for (size_t i = 0; i + 1 < snap.fieldEnds.size(); i++) {
+            if (i > 0) out += ',';
+            snap.appendField(out, i, w);
+        }
+        out += "}\n\n";
+    };
+    joinFrame(snap.sse, nullptr);
+    for (Snapshot::CpuWindow& w : snap.cpuWindows) joinFrame(w.sse, &w);
+
+    binaryEncoder.begin();
+    visitMetrics(snap, binaryEncoder);
+    for (const Snapshot::CpuWindow& w : snap.cpuWindows) {
+        binaryEncoder.scalarFor(w.intervalMs, "cpu", w.cpu);
+        binaryEncoder.scalarFor(w.intervalMs, "cpu_process", w.cpuProcess);
+        binaryEncoder.scalarFor(w.intervalMs, "cpu_iowait", w.cpuIoWait);
+        binaryEncoder.scalarFor(w.intervalMs, "cpu_steal", w.cpuSteal);
+    }
+    binaryEncoder.finish(snap.seq, snap.timestampMs, snap.intervals, snap.binKey, snap.binDeltas);
+
+    // History keeps its own fixed period whatever the stream intervals are.
+    if (!snap.historyDue) return;
+    std::vector<double> values;
+    ScalarCollector scalars{nullptr, &values};
+    visitMetrics(snap, scalars);
+    history->append(snap.timestampMs, values.data());
+    rollups->add(snap.timestampMs, values.data());
+#ifndef _WIN32
+    if (segmentStore) segmentStore->append(snap.timestampMs, values.data());
 #endif
+}
 
 
 // Server setup
 int main() {
+    init();
+
+    sampleCpu();
+
+    std::vector<std::string> columns;
+    std::vector<int> decimals;
+    ScalarCollector names{&columns, nullptr, &decimals};
+    visitMetrics(Snapshot(), names);
+#ifndef _WIN32
+    if (const char* dir = getenv("MONITOR_DATA_DIR")) {
+        segmentStore = std::make_unique<SegmentStore>(dir, columns, decimals);
+        if (!segmentStore->open()) {
+            fprintf(stderr, "cannot open data directory %s\n", dir);
+            segmentStore.reset();
+        }
+    }
+#endif
+    startedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::vector<std::string> fieldNames;
+    json emptyFields = streamJson(Snapshot());
+    for (auto& field : emptyFields.items()) fieldNames.push_back(field.key());
+    streamFields.setFields(std::move(fieldNames));
+    rollups = std::make_unique<Rollups>(columns.size());
+    history = std::make_unique<MetricHistory>(
+        (size_t)(historyRetention() / samplePeriod), std::move(columns));
+
+    loadAlertRules();
+
+    MetricsHub hub;
+    Sampler sampler(hub, samplePeriod, [&hub](Snapshot& snap, const Snapshot* previous) {
+        collect(snap, previous);
+        evaluateAlerts(snap, hub);
+    }, collectorIntervals());
+    sampler.start();
+    startPressureTriggers(hub);
+
+#ifdef _WIN32
     httplib::Server server;
+#else
+    // Stream subscribers are served by one epoll thread; the route below is
+    // only used for streams requested on a reused keep-alive connection.
+    SseStreamer streamer(hub, streamFields, samplePeriod);
+    streamer.start();
+    StreamingServer server(streamer);
+#endif
+
+    server.Get("/metrics/stream", [&hub](const httplib::Request& req, httplib::Response& res) {
+        bool binary = req.get_param_value("format") == "bin";
+        std::shared_ptr<FieldSelection> selection =
+            binary ? nullptr : streamFields.select(req.get_param_value("metrics"));
+        const char* contentType = binary ? "application/octet-stream" : "text/event-stream";
+        uint32_t interval = (uint32_t)Sampler::parseInterval(req.get_param_value("interval"), samplePeriod).count();
+        hub.addInterval(interval);
 
-    server.Get("/metrics/stream", [](const httplib::Request&, httplib::Response& res) {
-        res.set_header("Content-Type", "text/event-stream");
         res.set_header("Cache-Control", "no-cache");
         res.set_header("Connection", "keep-alive");
         res.set_header("Access-Control-Allow-Origin", "http://localhost");
 
         res.set_chunked_content_provider(
-            "text/event-stream",
-            [](size_t, httplib::DataSink& sink) {
-                json data = {
-                    {"status", "connected"},
-                    {"cpu", getCPU()},
-                    {"cpu_process", getCPUProcess()},
-                    {"total_ram", getTotalPhysicalMemory()},
-                    {"used_ram", getUsedPhysicalMemory()},
-                    {"process_ram", getProcessPhysicalMemory()},
-                    {"total_virtual_ram", getTotalVirtualMemory()},
-                    {"used_virtual_ram", getUsedVirtualMemory()},
-                    {"process_virtual_ram", getProcessVirtualMemory()}
-                };
-
-                std::string msg = "data: " + data.dump() + "\n\n";
-                sink.write(msg.data(), msg.size());
-
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-
-                return true;
-            }
+            contentType,
+            [&hub, binary, selection, interval, seq = uint64_t(0), eventSeq = hub.eventSeq()](size_t, httplib::DataSink& sink) mutable {
+                // Every sink gets the same pre-serialized frame; nothing is
+                // sampled or serialized per client. Snapshots taken for other
+                // intervals are skipped, except the first.
+                SnapshotPtr snap = hub.waitNext(seq);
+                for (uint64_t last = seq; snap && last != 0 && !snap->dueFor(interval);) {
+                    last = snap->seq;
+                    snap = hub.waitNext(last);
+                }
+                if (!snap) return false;
+
+                // Events wait for the next snapshot on this path; the epoll
+                // streamer sends them as soon as they are published.
+                for (const MetricsHub::Event& e : hub.eventsSince(eventSeq)) {
+                    eventSeq = e.seq;
+                    if (!binary && !sink.write(e.frame->data(), e.frame->size())) return false;
+                }
+
+                // A binary client that missed its interval's previous snapshot
+                // restarts from a key frame.
+                FieldSelection::Frame selected = selection ? selection->frame(snap, interval) : nullptr;
+                const std::string& frame = selected ? *selected : !binary ? snap->sseFor(interval)
+                    : snap->binFrame(interval, seq);
+                seq = snap->seq;
+
+                return sink.write(frame.data(), frame.size());
+            },
+            [&hub, interval](bool) { hub.removeInterval(interval); }
         );
     });
 
+    // Downsampled history: ?from=&to= in ms since the epoch, ?step= in ms.
+    // Defaults to the whole raw retention window in at most 1000 points.
+    // Steps of a second or more are served from the coarsest rollup tier
+    // that fits and still reaches back to `from`, and also carry per-bucket
+    // min, max and p95. Finer steps use raw samples while they cover the
+    // range. Ranges starting before this process started are read from
+    // disk when persistence is on.
+    server.Get("/metrics/history", [](const httplib::Request& req, httplib::Response& res) {
+        auto param = [&](const char* key, int64_t fallback) {
+            return req.has_param(key) ? atoll(req.get_param_value(key).c_str()) : fallback;
+        };
+
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t retentionMs = std::chrono::milliseconds(historyRetention()).count();
+        int64_t to = param("to", now);
+        int64_t from = param("from", to - retentionMs);
+        int64_t step = param("step", std::max<int64_t>(samplePeriod.count(), (to - from) / 1000));
+
+        if (to < from || step <= 0) {
+            res.status = 400;
+            return;
+        }
+
+        const std::vector<std::string>& columns = history->columns();
+        auto byColumn = [&](const std::vector<std::vector<double>>& values) {
+            json out = json::object();
+            for (size_t c = 0; c < columns.size(); c++) out[columns[c]] = values[c];
+            return out;
+        };
+
+        const RollupTier* tier = rollups->pick(step, now - from);
+        // Raw samples beat a tier coarser than the step when they cover the range.
+        if (tier->widthMs() > step && now - from <= retentionMs) tier = nullptr;
+
+        json body = {{"from", from}, {"to", to}, {"step", step}};
+#ifndef _WIN32
+        if (segmentStore && from < startedMs) {
+            SegmentStore::Series series = segmentStore->query(from, to, step);
+            body["tier"] = "disk";
+            body["timestamps"] = series.timestamps;
+            body["series"] = byColumn(series.values);
+        } else
+#endif
+        if (tier) {
+            RollupTier::Series series = tier->query(from, to, step);
+            body["tier"] = tier->name();
+            body["timestamps"] = series.timestamps;
+            body["series"] = byColumn(series.mean);
+            body["min"] = byColumn(series.min);
+            body["max"] = byColumn(series.max);
+            body["p95"] = byColumn(series.p95);
+        } else {
+            MetricHistory::Series series = history->query(from, to, step);
+            body["tier"] = "raw";
+            body["timestamps"] = series.timestamps;
+            body["series"] = byColumn(series.values);
+        }
+
+        res.set_header("Access-Control-Allow-Origin", "http://localhost");
+        res.set_content(body.dump(), "application/json");
+    });
+
+    // Prometheus text exposition of the latest snapshot, rendered at most
+    // once per tick however many scrapers ask. Served gzip-compressed when
+    // built with CPPHTTPLIB_ZLIB_SUPPORT and the scraper accepts it.
+    ExpositionCache exposition([](const Snapshot& snap, std::string& out) {
+        std::vector<ArrayLabels> labels = arrayLabels(snap);
+        PrometheusWriter writer(out, labels);
+        visitMetrics(snap, writer);
+    });
+    server.Get("/metrics", [&hub, &exposition](const httplib::Request& req, httplib::Response& res) {
+        SnapshotPtr snap = hub.latest();
+        if (!snap) {
+            res.status = 503;
+            return;
+        }
+
+        ExpositionCache::Body body;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        if (req.get_header_value("Accept-Encoding").find("gzip") != std::string::npos) {
+            body = exposition.gzip(snap);
+            if (body) res.set_header("Content-Encoding", "gzip");
+        }
+#else
+        (void)req;
+#endif
+        if (!body) body = exposition.text(snap);
+
+        // A content provider writes the shared buffer as it is; set_content()
+        // would copy it per scrape and let httplib compress it again.
+        res.set_content_provider(body->size(), "text/plain; version=0.0.4; charset=utf-8",
+            [body](size_t offset, size_t length, httplib::DataSink& sink) {
+                return sink.write(body->data() + offset, length);
+            });
+    });
+
+    // Every alert rule with its current state, value and the time of its
+    // last state change.
+    server.Get("/alerts", [](const httplib::Request&, httplib::Response& res) {
+        std::vector<AlertEngine::Status> status = alerts.status();
+        json list = json::array();
+        for (size_t i = 0; i < status.size(); i++) {
+            const AlertEngine::Rule& rule = alerts.rule(i);
+            list.push_back({
+                {"rule", rule.name},
+                {"metric", rule.metric},
+                {"key", rule.key},
+                {"state", alertStateName(status[i].state)},
+                {"value", status[i].value},
+                {"threshold", rule.threshold},
+                {"since", status[i].sinceMs},
+            });
+        }
+
+        res.set_header("Access-Control-Allow-Origin", "http://localhost");
+        res.set_content(json{{"alerts", list}}.dump(), "application/json");
+    });
 
     server.listen("0.0.0.0", 80);
+
+    hub.stop();
+    sampler.stop();
+#ifndef _WIN32
+    pressureTriggers.stop();
+    streamer.stop();
+    segmentStore.reset();
+#endif
 }
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "proc_reader.h"
+#include "sampler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// A /proc file of header/value line pairs ("Tcp: RtoMin ..." followed by
+// "Tcp: 200 ..."), such as /proc/net/snmp and /proc/net/netstat. The
+// requested fields' columns are located once in open(); read() finds each
+// section's value line by its prefix, as sections before it (IcmpMsg: in
+// /proc/net/snmp) come and go at runtime, and walks it to those columns.
+class KeyedCounterFile {
+public:
+    struct Field {
+        const char* section; // without the colon
+        const char* name;
+    };
+
+    // Fields that do not exist on this kernel read as 0.
+    bool open(const char* path, const Field* fields, size_t count) {
+        if (!file_.open(path)) return false;
+        buf_.resize(16384);
+        ssize_t len = readAll();
+        if (len <= 0) return false;
+
+        sections_.clear();
+        locations_.assign(count, Location{});
+        for (size_t i = 0; i < count; i++) {
+            size_t s = 0;
+            while (s < sections_.size() && sections_[s] != fields[i].section) s++;
+            if (s == sections_.size()) sections_.push_back(fields[i].section);
+            locations_[i].section = (int)s;
+        }
+
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        int previous = NoSection;
+        do {
+            // A header line is the first of a pair; its values follow.
+            int section = sectionOf(tok.pos(), buf_.data() + len);
+            if (section >= 0 && section != previous) locate(tok.pos(), buf_.data() + len, section, fields, count);
+            previous = section >= 0 && section == previous ? NoSection : section;
+        } while (tok.nextLine());
+        return true;
+    }
+
+    // Fills `values` in the order of the fields given to open().
+    bool read(uint64_t* values) {
+        ssize_t len = readAll();
+        if (len <= 0) return false;
+
+        size_t count = locations_.size();
+        memset(values, 0, count * sizeof(uint64_t));
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        int previous = NoSection;
+        do {
+            const char* start = tok.pos();
+            int section = sectionOf(start, buf_.data() + len);
+            bool valueLine = section >= 0 && section == previous;
+            previous = valueLine ? NoSection : section;
+            if (!valueLine) continue;
+
+            // Fields in column order are found in one pass over the line;
+            // otherwise the line is rescanned from its start.
+            tok.skip(sections_[section].size() + 1);
+            const char* first = tok.pos();
+            size_t column = 0;
+            uint64_t v = 0;
+            for (size_t i = 0; i < count; i++) {
+                const Location& l = locations_[i];
+                if (l.section != section || l.column == NoColumn) continue;
+                if (column > l.column) {
+                    tok = ProcTokenizer(first, (size_t)(buf_.data() + len - first));
+                    column = 0;
+                }
+                // number() skips a '-' sign, which still counts as one column.
+                while (column <= l.column && tok.number(v)) column++;
+                if (column == l.column + 1) values[i] = v;
+            }
+        } while (tok.nextLine());
+        return true;
+    }
+
+private:
+    static constexpr int NoSection = -1;
+    static constexpr size_t NoColumn = (size_t)-1;
+
+    struct Location {
+        int section = NoSection;
+        size_t column = NoColumn;
+    };
+
+    ssize_t readAll() {
+        for (;;) {
+            ssize_t len = file_.read(buf_.data(), buf_.size());
+            if (len <= 0 || (size_t)len < buf_.size() - 1) return len;
+            buf_.resize(buf_.size() * 2);
+        }
+    }
+
+    // Index into sections_ of the line starting at p, or NoSection.
+    int sectionOf(const char* p, const char* end) const {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        const char* colon = (const char*)memchr(p, ':', (size_t)((nl ? nl : end) - p));
+        if (!colon) return NoSection;
+        size_t len = (size_t)(colon - p);
+        for (size_t s = 0; s < sections_.size(); s++) {
+            if (sections_[s].size() == len && memcmp(sections_[s].data(), p, len) == 0) return (int)s;
+        }
+        return NoSection;
+    }
+
+    void locate(const char* p, const char* end, int section, const Field* fields, size_t count) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (!nl) nl = end;
+        const char* colon = p + sections_[section].size();
+
+        for (size_t i = 0; i < count; i++) {
+            if (locations_[i].section != section) continue;
+
+            size_t nameLen = strlen(fields[i].name);
+            size_t column = 0;
+            for (const char* w = colon + 1; w < nl;) {
+                while (w < nl && *w == ' ') w++;
+                const char* wordEnd = w;
+                while (wordEnd < nl && *wordEnd != ' ') wordEnd++;
+                if (wordEnd == w) break;
+                if ((size_t)(wordEnd - w) == nameLen && memcmp(w, fields[i].name, nameLen) == 0) {
+                    locations_[i].column = column;
+                    break;
+                }
+                column++;
+                w = wordEnd;
+            }
+        }
+    }
+
+    ProcFile file_;
+    std::vector<char> buf_;
+    std::vector<std::string> sections_;
+    std::vector<Location> locations_;
+};
+
+// TCP and UDP protocol counters from /proc/net/snmp and /proc/net/netstat,
+// as per-second rates.
+class ProtocolCounters {
+public:
+    bool open() {
+        bool snmp = snmp_.open("/proc/net/snmp", snmpFields, SnmpCount);
+        bool netstat = netstat_.open("/proc/net/netstat", netstatFields, NetstatCount);
+        return snmp || netstat;
+    }
+
+    bool read(ProtocolRates& out) {
+        uint64_t cur[CounterCount] = {};
+        bool ok = snmp_.read(cur);
+        ok = netstat_.read(cur + SnmpCount) || ok;
+        if (!ok) return false;
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRead_).count();
+        bool first = lastRead_ == std::chrono::steady_clock::time_point();
+        lastRead_ = now;
+
+        if (!first) {
+            auto delta = [&](int f) { return cur[f] >= prev_[f] ? (double)(cur[f] - prev_[f]) : 0.0; };
+            auto rate = [&](int f) { return delta(f) / elapsed; };
+            out.tcpOutSegs = rate(TcpOutSegs);
+            out.tcpRetrans = rate(TcpRetransSegs);
+            out.tcpRetransPercent = delta(TcpOutSegs) > 0
+                ? delta(TcpRetransSegs) / delta(TcpOutSegs) * 100 : 0;
+            out.tcpInErrors = rate(TcpInErrs);
+            out.tcpOutResets = rate(TcpOutRsts);
+            out.tcpEstabResets = rate(TcpEstabResets);
+            out.tcpAttemptFails = rate(TcpAttemptFails);
+            out.udpInDatagrams = rate(UdpInDatagrams);
+            out.udpInErrors = rate(UdpInErrors);
+            out.udpRcvbufErrors = rate(UdpRcvbufErrors);
+            out.udpSndbufErrors = rate(UdpSndbufErrors);
+            out.udpNoPorts = rate(UdpNoPorts);
+            out.tcpListenOverflows = rate(ListenOverflows);
+            out.tcpListenDrops = rate(ListenDrops);
+            out.tcpTimeouts = rate(TcpTimeouts);
+        }
+        memcpy(prev_, cur, sizeof(prev_));
+        return true;
+    }
+
+private:
+    // In column order within each section; /proc/net/snmp fields first.
+    enum { TcpAttemptFails, TcpEstabResets, TcpOutSegs, TcpRetransSegs, TcpInErrs, TcpOutRsts,
+           UdpInDatagrams, UdpNoPorts, UdpInErrors, UdpRcvbufErrors, UdpSndbufErrors,
+           ListenOverflows, ListenDrops, TcpTimeouts, CounterCount };
+    static constexpr size_t SnmpCount = ListenOverflows;
+    static constexpr size_t NetstatCount = CounterCount - ListenOverflows;
+
+    static constexpr KeyedCounterFile::Field snmpFields[SnmpCount] = {
+        {"Tcp", "AttemptFails"}, {"Tcp", "EstabResets"}, {"Tcp", "OutSegs"},
+        {"Tcp", "RetransSegs"}, {"Tcp", "InErrs"}, {"Tcp", "OutRsts"},
+        {"Udp", "InDatagrams"}, {"Udp", "NoPorts"}, {"Udp", "InErrors"},
+        {"Udp", "RcvbufErrors"}, {"Udp", "SndbufErrors"},
+    };
+    static constexpr KeyedCounterFile::Field netstatFields[NetstatCount] = {
+        {"TcpExt", "ListenOverflows"}, {"TcpExt", "ListenDrops"}, {"TcpExt", "TCPTimeouts"},
+    };
+
+    KeyedCounterFile snmp_;
+    KeyedCounterFile netstat_;
+    uint64_t prev_[CounterCount] = {};
+    std::chrono::steady_clock::time_point lastRead_;
+};
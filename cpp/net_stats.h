@@ -0,0 +1,143 @@
+#pragma once
+
+#include "proc_reader.h"
+#include "sampler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Parses /proc/net/dev into per-interface rates. Rows are matched to an
+// interface index by comparing names in place; the index is only rebuilt
+// when an interface appears or disappears, so steady state does no
+// allocation beyond the snapshot's own vectors (interface names are at most
+// 15 bytes and fit std::string's inline buffer).
+class NetDevReader {
+public:
+    bool open() {
+        buf_.resize(16384);
+        return file_.open("/proc/net/dev");
+    }
+
+    bool read(NetStats& out) {
+        ssize_t len;
+        for (;;) {
+            len = file_.read(buf_.data(), buf_.size());
+            if (len <= 0) return false;
+            if ((size_t)len < buf_.size() - 1) break;
+            buf_.resize(buf_.size() * 2);
+        }
+
+        // Two header lines, then "name: 16 counters" per interface.
+        ProcTokenizer tok(buf_.data(), (size_t)len);
+        if (!tok.nextLine() || !tok.nextLine()) return false;
+
+        size_t rows = 0;
+        bool changed = false;
+        do {
+            tok.skipSpaces();
+            const char* name = tok.pos();
+            const char* colon = (const char*)memchr(name, ':', (size_t)(buf_.data() + len - name));
+            if (!colon) break;
+            size_t nameLen = (size_t)(colon - name);
+            tok.skip(nameLen + 1);
+
+            if (rows == rows_.size()) rows_.emplace_back();
+            Row& r = rows_[rows++];
+            r.nameOffset = (size_t)(name - buf_.data());
+            r.nameLength = nameLen;
+            for (int f = 0; f < FieldCount; f++) {
+                if (!tok.number(r.fields[f])) r.fields[f] = 0;
+            }
+
+            size_t i = rows - 1;
+            changed = changed || i >= interfaces_.size() ||
+                      interfaces_[i].name.size() != nameLen ||
+                      memcmp(interfaces_[i].name.data(), name, nameLen) != 0;
+        } while (tok.nextLine());
+        changed = changed || rows != interfaces_.size();
+        if (changed) rebuild(rows);
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRead_).count();
+        bool first = lastRead_ == std::chrono::steady_clock::time_point();
+        lastRead_ = now;
+
+        reserve(out, rows);
+        for (size_t i = 0; i < rows; i++) {
+            Interface& itf = interfaces_[i];
+            if (itf.name == "lo") continue;
+            const uint64_t* cur = rows_[i].fields;
+            if (!first && itf.valid) addRates(itf, cur, elapsed, out);
+            memcpy(itf.previous, cur, sizeof(itf.previous));
+            itf.valid = true;
+        }
+        return true;
+    }
+
+private:
+    // Columns after "name:".
+    enum { RxBytes, RxPackets, RxErrors, RxDrops, RxFifo, RxFrame, RxCompressed, RxMulticast,
+           TxBytes, TxPackets, TxErrors, TxDrops, TxFifo, TxCollisions, TxCarrier, TxCompressed,
+           FieldCount };
+
+    struct Row {
+        size_t nameOffset = 0, nameLength = 0;
+        uint64_t fields[FieldCount] = {};
+    };
+
+    struct Interface {
+        std::string name;
+        bool valid = false; // previous holds a reading
+        uint64_t previous[FieldCount] = {};
+    };
+
+    // Keeps the counters of interfaces that are still present.
+    void rebuild(size_t rows) {
+        std::vector<Interface> old;
+        old.swap(interfaces_);
+        for (size_t i = 0; i < rows; i++) {
+            Interface itf;
+            itf.name.assign(buf_.data() + rows_[i].nameOffset, rows_[i].nameLength);
+            for (const Interface& o : old) {
+                if (o.valid && o.name == itf.name) {
+                    itf.valid = true;
+                    memcpy(itf.previous, o.previous, sizeof(itf.previous));
+                }
+            }
+            interfaces_.push_back(std::move(itf));
+        }
+    }
+
+    static void reserve(NetStats& out, size_t n) {
+        out.name.reserve(n);
+        for (auto* v : {&out.rxBytes, &out.txBytes, &out.rxPackets, &out.txPackets,
+                        &out.rxErrors, &out.txErrors, &out.rxDrops, &out.txDrops}) {
+            v->reserve(n);
+        }
+    }
+
+    static void addRates(const Interface& itf, const uint64_t* cur, double elapsed, NetStats& out) {
+        // Counters restart from 0 when a driver is reloaded.
+        auto rate = [&](int f) {
+            return cur[f] >= itf.previous[f] ? (double)(cur[f] - itf.previous[f]) / elapsed : 0.0;
+        };
+        out.name.push_back(itf.name);
+        out.rxBytes.push_back(rate(RxBytes));
+        out.txBytes.push_back(rate(TxBytes));
+        out.rxPackets.push_back(rate(RxPackets));
+        out.txPackets.push_back(rate(TxPackets));
+        out.rxErrors.push_back(rate(RxErrors));
+        out.txErrors.push_back(rate(TxErrors));
+        out.rxDrops.push_back(rate(RxDrops));
+        out.txDrops.push_back(rate(TxDrops));
+    }
+
+    ProcFile file_;
+    std::vector<char> buf_;
+    std::vector<Row> rows_;             // reused; only the first `rows` are current
+    std::vector<Interface> interfaces_; // same order as the rows of the file
+    std::chrono::steady_clock::time_point lastRead_;
+};
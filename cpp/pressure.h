@@ -0,0 +1,200 @@
+#pragma once
+
+#include "proc_reader.h"
+#include "sampler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Cumulative stall time in microseconds from a PSI file ("some avg10=..
+// total=N" and "full ... total=N"). Missing lines leave their value alone.
+inline bool readPressureTotals(const ProcFile& file, char* buf, size_t size,
+                               uint64_t& some, uint64_t& full) {
+    ssize_t len = file.read(buf, size);
+    if (len <= 0) return false;
+    ProcTokenizer tok(buf, (size_t)len);
+    do {
+        uint64_t* total = tok.startsWith("some ", 5) ? &some : tok.startsWith("full ", 5) ? &full : nullptr;
+        if (!total) continue;
+        const char* line = tok.pos();
+        const char* end = (const char*)memchr(line, '\n', (size_t)(buf + len - line));
+        const char* key = (const char*)memmem(line, (size_t)((end ? end : buf + len) - line), "total=", 6);
+        if (key) ProcTokenizer(key + 6, (size_t)(buf + len - key - 6)).number(*total);
+    } while (tok.nextLine());
+    return true;
+}
+
+// System-wide pressure stall information from /proc/pressure, as the
+// percent of each interval in which some or all non-idle tasks stalled.
+// Uses the cumulative totals rather than avg10, so a stall shows up in the
+// tick it happened in.
+class PressureReader {
+public:
+    bool open() {
+        bool cpu = files_[Cpu].open("/proc/pressure/cpu");
+        bool memory = files_[Memory].open("/proc/pressure/memory");
+        bool io = files_[Io].open("/proc/pressure/io");
+        return cpu || memory || io;
+    }
+
+    bool read(PressureStats& out) {
+        uint64_t cur[ResourceCount][2] = {};
+        bool ok = false;
+        for (int r = 0; r < ResourceCount; r++) {
+            ok = readPressureTotals(files_[r], buf_, sizeof(buf_), cur[r][0], cur[r][1]) || ok;
+        }
+        if (!ok) return false;
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRead_).count();
+        bool first = lastRead_ == std::chrono::steady_clock::time_point();
+        lastRead_ = now;
+
+        if (!first) {
+            auto percent = [&](int r, int k) {
+                return cur[r][k] >= prev_[r][k] ? (cur[r][k] - prev_[r][k]) / elapsed / 1e4 : 0.0;
+            };
+            out.cpuSome = percent(Cpu, 0);
+            out.cpuFull = percent(Cpu, 1);
+            out.memorySome = percent(Memory, 0);
+            out.memoryFull = percent(Memory, 1);
+            out.ioSome = percent(Io, 0);
+            out.ioFull = percent(Io, 1);
+        }
+        memcpy(prev_, cur, sizeof(prev_));
+        return true;
+    }
+
+private:
+    enum { Cpu, Memory, Io, ResourceCount };
+
+    ProcFile files_[ResourceCount];
+    char buf_[512];
+    uint64_t prev_[ResourceCount][2] = {};
+    std::chrono::steady_clock::time_point lastRead_;
+};
+
+// PSI triggers: the kernel wakes poll() as soon as stall time within a
+// window crosses a threshold, instead of the monitor finding out on its next
+// tick. Runs one thread blocked in poll() on every trigger.
+class PressureTriggers {
+public:
+    struct Trigger {
+        std::string resource; // cpu, memory or io
+        std::string kind;     // some or full
+        uint64_t stallUs = 0;
+        uint64_t windowUs = 0;
+        int fd = -1;
+    };
+
+    // Called on the trigger thread each time a trigger fires.
+    using Handler = std::function<void(const Trigger&, double avg10)>;
+
+    ~PressureTriggers() {
+        stop();
+        for (Trigger& t : triggers_) ::close(t.fd);
+    }
+
+    // Registers "some 150000 1000000" style triggers on /proc/pressure/
+    // `resource`. Without CAP_SYS_RESOURCE the kernel only accepts windows
+    // that are a multiple of 2 s; those are widened, keeping the stall
+    // threshold's share of the window.
+    bool add(const std::string& resource, const std::string& kind, uint64_t stallUs, uint64_t windowUs) {
+        std::string path = "/proc/pressure/" + resource;
+        int fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        const uint64_t unprivileged = 2000000;
+        bool armed = arm(fd, kind, stallUs, windowUs);
+        if (!armed && errno == EINVAL && windowUs > 0 && windowUs % unprivileged != 0) {
+            uint64_t window = (windowUs + unprivileged - 1) / unprivileged * unprivileged;
+            stallUs = stallUs * window / windowUs;
+            windowUs = window;
+            armed = arm(fd, kind, stallUs, windowUs);
+        }
+        if (!armed) {
+            ::close(fd);
+            return false;
+        }
+        triggers_.push_back({resource, kind, stallUs, windowUs, fd});
+        return true;
+    }
+
+    bool start(Handler handler) {
+        if (triggers_.empty()) return false;
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd_ < 0) return false;
+        running_ = true;
+        thread_ = std::thread([this, handler = std::move(handler)] { run(handler); });
+        return true;
+    }
+
+    void stop() {
+        if (!running_.exchange(false)) return;
+        uint64_t one = 1;
+        ssize_t n = write(wakeFd_, &one, sizeof(one));
+        (void)n;
+        if (thread_.joinable()) thread_.join();
+        ::close(wakeFd_);
+    }
+
+    const std::vector<Trigger>& triggers() const { return triggers_; }
+
+private:
+    static bool arm(int fd, const std::string& kind, uint64_t stallUs, uint64_t windowUs) {
+        char spec[64];
+        int len = snprintf(spec, sizeof(spec), "%s %llu %llu", kind.c_str(),
+                           (unsigned long long)stallUs, (unsigned long long)windowUs);
+        return write(fd, spec, (size_t)len + 1) == len + 1;
+    }
+
+    void run(const Handler& handler) {
+        std::vector<pollfd> fds;
+        for (const Trigger& t : triggers_) fds.push_back({t.fd, POLLPRI, 0});
+        fds.push_back({wakeFd_, POLLIN, 0});
+
+        char buf[256];
+        while (running_) {
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (size_t i = 0; i < triggers_.size(); i++) {
+                if (fds[i].revents & POLLERR) {
+                    fds[i].fd = -1; // poll() ignores negative fds
+                } else if (fds[i].revents & POLLPRI) {
+                    handler(triggers_[i], avg10(triggers_[i], buf, sizeof(buf)));
+                }
+            }
+        }
+    }
+
+    // The line's avg10 at the time the trigger fired.
+    static double avg10(const Trigger& t, char* buf, size_t size) {
+        ssize_t len = pread(t.fd, buf, size - 1, 0);
+        if (len <= 0) return 0;
+        buf[len] = '\0';
+        const char* line = strstr(buf, t.kind.c_str());
+        const char* avg = line ? strstr(line, "avg10=") : nullptr;
+        return avg ? atof(avg + 6) : 0;
+    }
+
+    std::vector<Trigger> triggers_;
+    int wakeFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
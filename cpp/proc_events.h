@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Process fork/exit notifications from the kernel's netlink proc connector.
+// Events are handled on a dedicated thread as they arrive, so an exiting
+// process can still be inspected while it is a zombie. Threads are ignored.
+//
+// Subscribing needs CAP_NET_ADMIN in the initial network namespace; start()
+// returns false without it and callers fall back to polling /proc.
+class ProcConnector {
+public:
+    using Callback = std::function<void(uint32_t pid)>;
+
+    ~ProcConnector() { stop(); }
+
+    bool start(Callback onFork, Callback onExit) {
+        fd_ = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (fd_ < 0) return false;
+
+        // Room for bursts of fork/exit between ticks; an overrun is reported
+        // through takeOverflow().
+        int size = 4 << 20;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        // Lets the thread notice stop() without a wake-up fd.
+        timeval timeout{0, 200 * 1000};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        sockaddr_nl addr{};
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = CN_IDX_PROC;
+        addr.nl_pid = 0;
+        if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0 || !subscribe(PROC_CN_MCAST_LISTEN)) {
+            close();
+            return false;
+        }
+
+        onFork_ = std::move(onFork);
+        onExit_ = std::move(onExit);
+        running_ = true;
+        thread_ = std::thread([this] { loop(); });
+        return true;
+    }
+
+    void stop() {
+        if (!running_.exchange(false)) return;
+        thread_.join();
+        subscribe(PROC_CN_MCAST_IGNORE);
+        close();
+    }
+
+    bool running() const { return running_; }
+
+    // True if events were dropped since the last call; the caller must then
+    // rebuild its process list from /proc.
+    bool takeOverflow() { return overflow_.exchange(false); }
+
+private:
+    bool subscribe(proc_cn_mcast_op op) {
+        // nlmsghdr, then cn_msg, whose payload is the operation.
+        alignas(nlmsghdr) char request[NLMSG_SPACE(sizeof(cn_msg) + sizeof(op))] = {};
+        nlmsghdr* header = (nlmsghdr*)request;
+        header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(op));
+        header->nlmsg_type = NLMSG_DONE;
+        header->nlmsg_pid = (uint32_t)getpid();
+
+        cn_msg* message = (cn_msg*)NLMSG_DATA(header);
+        message->id.idx = CN_IDX_PROC;
+        message->id.val = CN_VAL_PROC;
+        message->len = sizeof(op);
+        memcpy(message->data, &op, sizeof(op));
+        return send(fd_, request, header->nlmsg_len, 0) == (ssize_t)header->nlmsg_len;
+    }
+
+    void loop() {
+        alignas(nlmsghdr) char buf[8192];
+        while (running_) {
+            ssize_t len = recv(fd_, buf, sizeof(buf), 0);
+            if (len < 0) {
+                if (errno == ENOBUFS) overflow_ = true;
+                continue; // timeout or interrupted
+            }
+
+            for (nlmsghdr* h = (nlmsghdr*)buf; NLMSG_OK(h, (size_t)len); h = NLMSG_NEXT(h, len)) {
+                if (h->nlmsg_type == NLMSG_ERROR || h->nlmsg_type == NLMSG_NOOP) continue;
+                const cn_msg* msg = (const cn_msg*)NLMSG_DATA(h);
+                if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) continue;
+                handle(*(const proc_event*)msg->data);
+            }
+        }
+    }
+
+    void handle(const proc_event& e) {
+        switch (e.what) {
+        case proc_event::PROC_EVENT_FORK:
+            if (e.event_data.fork.child_pid == e.event_data.fork.child_tgid) {
+                onFork_((uint32_t)e.event_data.fork.child_tgid);
+            }
+            break;
+        case proc_event::PROC_EVENT_EXIT:
+            if (e.event_data.exit.process_pid == e.event_data.exit.process_tgid) {
+                onExit_((uint32_t)e.event_data.exit.process_tgid);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> overflow_{false};
+    Callback onFork_;
+    Callback onExit_;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// A /proc file opened once and re-read from offset 0 with pread(), so a
+// sample costs one syscall and no stdio buffers.
+class ProcFile {
+public:
+    ProcFile() = default;
+    explicit ProcFile(const char* path) { open(path); }
+    ~ProcFile() { close(); }
+
+    ProcFile(const ProcFile&) = delete;
+    ProcFile& operator=(const ProcFile&) = delete;
+
+    ProcFile(ProcFile&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+    ProcFile& operator=(ProcFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+
+    bool open(const char* path) {
+        close();
+        fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+        return fd_ >= 0;
+    }
+
+    // Opens `name` relative to an already open directory fd.
+    bool openAt(int dirFd, const char* name) {
+        close();
+        fd_ = ::openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+        return fd_ >= 0;
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    // Reads up to size - 1 bytes from the start of the file and
+    // NUL-terminates them. Returns the length read, or -1 on error.
+    ssize_t read(char* buf, size_t size) const {
+        if (fd_ < 0 || size == 0) return -1;
+        size_t len = 0;
+        while (len < size - 1) {
+            ssize_t n = pread(fd_, buf + len, size - 1 - len, (off_t)len);
+            if (n < 0) return -1;
+            if (n == 0) break;
+            len += (size_t)n;
+        }
+        buf[len] = '\0';
+        return (ssize_t)len;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// Zero-allocation cursor over text read from /proc. Never reads past `end`.
+class ProcTokenizer {
+public:
+    ProcTokenizer(const char* buf, size_t len) : p_(buf), end_(buf + len) {}
+
+    bool atEnd() const { return p_ >= end_; }
+    const char* pos() const { return p_; }
+
+    // True if the current position starts with `prefix`.
+    bool startsWith(const char* prefix, size_t len) const {
+        return (size_t)(end_ - p_) >= len && memcmp(p_, prefix, len) == 0;
+    }
+
+    // Moves to the start of the next line. Returns false at end of buffer.
+    bool nextLine() {
+        const char* nl = (const char*)memchr(p_, '\n', end_ - p_);
+        p_ = nl ? nl + 1 : end_;
+        return p_ < end_;
+    }
+
+    // Moves to the first line starting with `key`. Returns false if none.
+    bool findLine(const char* key) {
+        size_t len = strlen(key);
+        do {
+            if (startsWith(key, len)) return true;
+        } while (nextLine());
+        return false;
+    }
+
+    void skip(size_t n) { p_ = (size_t)(end_ - p_) > n ? p_ + n : end_; }
+
+    void skipSpaces() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t')) p_++;
+    }
+
+    // Skips the current whitespace-delimited word.
+    void skipWord() {
+        skipSpaces();
+        while (p_ < end_ && *p_ != ' ' && *p_ != '\t' && *p_ != '\n') p_++;
+    }
+
+    // Parses the next unsigned decimal on the current line. Leaves `value`
+    // untouched and returns false when the line has no more digits.
+    bool number(uint64_t& value) {
+        while (p_ < end_ && *p_ != '\n' && (*p_ < '0' || *p_ > '9')) p_++;
+        if (p_ >= end_ || *p_ == '\n') return false;
+
+        uint64_t v = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+            v = v * 10 + (uint64_t)(*p_ - '0');
+            p_++;
+        }
+        value = v;
+        return true;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+};
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "proc_events.h"
+#include "proc_reader.h"
+#include "scan_pool.h"
+#include "taskstats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// CPU and memory of every process on the host, read from /proc/[pid]/stat
+// once per scan. State is kept per (pid, starttime) in an open-addressing
+// table that is reused across scans, so once the table has grown to the
+// host's process count a scan does no heap allocation.
+//
+// The stat files are read by a ScanPool into per-worker buffers; the
+// sampler thread then merges them into the table, so workers never share
+// anything but the pid list.
+//
+// When the netlink proc connector is available, the pid list is kept up to
+// date from fork/exit events instead of listing /proc every tick, and a
+// process is read one last time as it exits, so short-lived processes
+// still show up with the CPU they used.
+class ProcessTable {
+public:
+    struct Process {
+        uint32_t pid = 0;       // 0 marks an empty slot
+        uint64_t startTime = 0; // clock ticks after boot; tells reused pids apart
+        uint64_t ticks = 0;     // utime + stime at the last scan
+        uint64_t seen = 0;      // scan generation that last saw the process
+        float cpu = 0;          // percent of one core since the previous scan
+        double rss = 0;         // bytes
+        char name[16] = {};
+        bool exited = false;    // final reading taken at exit
+
+        // Delay accounting, only for processes passed to setDelays().
+        TaskDelays delayTotals;
+        uint64_t delaysFetched = 0; // scan generation of delayTotals
+        // Percent of wall time spent waiting since the previous fetch.
+        float cpuDelay = 0, ioDelay = 0, swapDelay = 0, reclaimDelay = 0;
+    };
+
+    bool open(size_t threads) {
+        procFd_ = ::open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        hz_ = (double)sysconf(_SC_CLK_TCK);
+        pageSize_ = (double)sysconf(_SC_PAGESIZE);
+        dents_.resize(32768);
+        slots_.resize(1024);
+        pool_ = std::make_unique<ScanPool>(threads);
+        readings_.resize(pool_->workers());
+        if (procFd_ < 0) return false;
+
+        events_.start([this](uint32_t pid) { forked(pid); },
+                      [this](uint32_t pid) { exited(pid); });
+        return true;
+    }
+
+    ~ProcessTable() {
+        events_.stop();
+        if (procFd_ >= 0) ::close(procFd_);
+    }
+
+    size_t size() const { return count_; }
+
+    // Wall time of the last scan, in milliseconds.
+    double scanMs() const { return scanMs_; }
+
+    // Reads every process and drops the ones that have exited.
+    bool scan() {
+        if (procFd_ < 0) return false;
+
+        auto now = std::chrono::steady_clock::now();
+        elapsed_ = generation_ > 0 ? std::chrono::duration<double>(now - lastScan_).count() : 0;
+        lastScan_ = now;
+        generation_++;
+        previousBootTicks_ = bootTicks_;
+        bootTicks_ = bootTicks();
+
+        // Take the events gathered since the last scan, leaving the emptied
+        // buffers of the previous swap for the connector thread.
+        newPids_.clear();
+        finalReadings_.clear();
+        {
+            std::lock_guard<std::mutex> lock(eventsMutex_);
+            forkedPids_.swap(newPids_);
+            exitReadings_.swap(finalReadings_);
+        }
+
+        // Exits first, so processes that are gone are not read again.
+        for (const Reading& r : finalReadings_) update(r, true);
+
+        // Also list /proc now and then in case events stop arriving (for
+        // example in a network namespace the connector does not serve).
+        bool listed = !events_.running() || generation_ % ResyncEvery == 1 ||
+                      events_.takeOverflow();
+        pids_.clear();
+        if (listed) {
+            if (!listPids()) return false;
+        } else {
+            for (const Process& p : slots_) {
+                if (p.pid != 0 && !p.exited) pids_.push_back(p.pid);
+            }
+            for (uint32_t pid : newPids_) {
+                const Process* p = find(pid);
+                if (!p || p->exited) pids_.push_back(pid);
+            }
+        }
+
+        for (auto& r : readings_) r.clear();
+        pool_->run(pids_.size(), readOne_);
+
+        for (auto& worker : readings_) {
+            for (const Reading& r : worker) update(r, false);
+        }
+        removeExited();
+
+        scanMs_ = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - now).count();
+        return true;
+    }
+
+    // Stores delay totals fetched this scan. Rates need a fetch in the
+    // previous scan too, so they start at 0 for newly watched processes.
+    void setDelays(const std::vector<TaskDelays>& delays) {
+        for (const TaskDelays& d : delays) {
+            Process* p = find(d.pid);
+            if (!p) continue;
+
+            bool consecutive = p->delaysFetched + 1 == generation_ && elapsed_ > 0;
+            const TaskDelays& old = p->delayTotals;
+            auto rate = [&](uint64_t now, uint64_t before) {
+                return consecutive && now >= before
+                    ? (float)((now - before) / 1e9 / elapsed_ * 100.0) : 0.0f;
+            };
+            p->cpuDelay = rate(d.cpu, old.cpu);
+            p->ioDelay = rate(d.io, old.io);
+            p->swapDelay = rate(d.swap, old.swap);
+            p->reclaimDelay = rate(d.reclaim, old.reclaim);
+            p->delayTotals = d;
+            p->delaysFetched = generation_;
+        }
+    }
+
+    // The `n` processes with the largest `key`, highest first.
+    template <class Key>
+    void top(size_t n, Key key, std::vector<const Process*>& out) const {
+        // Min-heap of the best `n` seen so far.
+        auto greater = [&](const Process* a, const Process* b) { return key(*a) > key(*b); };
+        out.clear();
+        for (const Process& p : slots_) {
+            if (p.pid == 0) continue;
+            if (out.size() < n) {
+                out.push_back(&p);
+                std::push_heap(out.begin(), out.end(), greater);
+            } else if (n > 0 && key(p) > key(*out.front())) {
+                std::pop_heap(out.begin(), out.end(), greater);
+                out.back() = &p;
+                std::push_heap(out.begin(), out.end(), greater);
+            }
+        }
+        std::sort_heap(out.begin(), out.end(), greater);
+    }
+
+private:
+    static constexpr uint64_t ResyncEvery = 120;
+
+    struct Dirent {
+        uint64_t ino;
+        int64_t off;
+        unsigned short reclen;
+        unsigned char type;
+        char name[1];
+    };
+
+    // getdents64 into a reused buffer instead of readdir(), which allocates
+    // a DIR per scan.
+    bool listPids() {
+        if (lseek(procFd_, 0, SEEK_SET) != 0) return false;
+        for (;;) {
+            long n = syscall(SYS_getdents64, procFd_, dents_.data(), dents_.size());
+            if (n <= 0) break;
+            for (long off = 0; off < n;) {
+                const Dirent* d = (const Dirent*)(dents_.data() + off);
+                off += d->reclen;
+                uint32_t pid = parsePid(d->name);
+                if (pid != 0) pids_.push_back(pid);
+            }
+        }
+        return true;
+    }
+
+    // Time since boot in the clock ticks that starttime is measured in.
+    uint64_t bootTicks() const {
+        timespec ts;
+        clock_gettime(CLOCK_BOOTTIME, &ts);
+        return (uint64_t)((ts.tv_sec + ts.tv_nsec / 1e9) * hz_);
+    }
+
+    // Proc connector callbacks, on the connector's thread.
+    void forked(uint32_t pid) {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        forkedPids_.push_back(pid);
+    }
+
+    void exited(uint32_t pid) {
+        // Read before the parent reaps it; lost if that already happened.
+        Reading r;
+        if (!read(pid, r)) return;
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        exitReadings_.push_back(r);
+    }
+
+    static uint32_t parsePid(const char* name) {
+        uint32_t pid = 0;
+        for (const char* p = name; *p; p++) {
+            if (*p < '0' || *p > '9') return 0;
+            pid = pid * 10 + (uint32_t)(*p - '0');
+        }
+        return pid;
+    }
+
+    // Fields of /proc/[pid]/stat after the command name, counted from 4
+    // (ppid) as numbered in proc(5).
+    enum { FieldUtime = 14, FieldStime = 15, FieldStartTime = 22, FieldRss = 24 };
+
+    // One stat file as read by a worker, before it is merged into the table.
+    struct Reading {
+        uint32_t pid;
+        uint64_t startTime;
+        uint64_t ticks;
+        uint64_t rssPages;
+        char name[16];
+    };
+
+    // Runs on pool workers; only touches the worker's own readings.
+    bool read(uint32_t pid, Reading& r) const {
+        char path[32];
+        snprintf(path, sizeof(path), "%u/stat", pid);
+        ProcFile file;
+        if (!file.openAt(procFd_, path)) return false; // exited since listing
+        char buf[1024];
+        ssize_t len = file.read(buf, sizeof(buf));
+        if (len <= 0) return false;
+
+        // The name may contain spaces and parentheses; it ends at the last ')'.
+        const char* nameStart = (const char*)memchr(buf, '(', (size_t)len);
+        const char* nameEnd = (const char*)memrchr(buf, ')', (size_t)len);
+        if (!nameStart || !nameEnd || nameEnd < nameStart) return false;
+
+        uint64_t fields[FieldRss + 1] = {};
+        ProcTokenizer tok(nameEnd + 1, (size_t)(buf + len - nameEnd - 1));
+        for (int f = 4; f <= FieldRss; f++) {
+            if (!tok.number(fields[f])) return false;
+        }
+
+        r.pid = pid;
+        r.startTime = fields[FieldStartTime];
+        r.ticks = fields[FieldUtime] + fields[FieldStime];
+        r.rssPages = fields[FieldRss];
+        size_t nameLen = std::min<size_t>((size_t)(nameEnd - nameStart - 1), sizeof(r.name) - 1);
+        memcpy(r.name, nameStart + 1, nameLen);
+        r.name[nameLen] = '\0';
+        return true;
+    }
+
+    void update(const Reading& r, bool exited) {
+        Process& p = slot(r.pid);
+        bool known = p.pid == r.pid && p.startTime == r.startTime;
+        if (!known) {
+            if (p.pid == 0) count_++;
+            p = Process();
+            p.pid = r.pid;
+            p.startTime = r.startTime;
+        }
+
+        // A process started since the previous scan used all of its CPU
+        // time within this interval.
+        uint64_t before = known ? p.ticks
+            : r.startTime >= previousBootTicks_ && generation_ > 1 ? 0 : r.ticks;
+        p.cpu = elapsed_ > 0 && r.ticks >= before
+            ? (float)((r.ticks - before) / hz_ / elapsed_ * 100.0) : 0;
+        p.exited = exited;
+        p.ticks = r.ticks;
+        p.rss = r.rssPages * pageSize_;
+        p.seen = generation_;
+        memcpy(p.name, r.name, sizeof(p.name));
+    }
+
+    Process* find(uint32_t pid) {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = home(pid);; i = (i + 1) & mask) {
+            Process& p = slots_[i];
+            if (p.pid == pid) return &p;
+            if (p.pid == 0) return nullptr;
+        }
+    }
+
+    size_t home(uint32_t pid) const {
+        return (size_t)(pid * 2654435761u) & (slots_.size() - 1);
+    }
+
+    // The slot holding `pid`, or the empty slot it should go in. A reused pid
+    // lands on its predecessor's slot and is reset by the caller.
+    Process& slot(uint32_t pid) {
+        if ((count_ + 1) * 2 > slots_.size()) grow();
+        size_t mask = slots_.size() - 1;
+        for (size_t i = home(pid);; i = (i + 1) & mask) {
+            Process& p = slots_[i];
+            if (p.pid == pid || p.pid == 0) return p;
+        }
+    }
+
+    void grow() {
+        std::vector<Process> old(slots_.size() * 2);
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (const Process& p : old) {
+            if (p.pid == 0) continue;
+            size_t i = home(p.pid);
+            while (slots_[i].pid != 0) i = (i + 1) & mask;
+            slots_[i] = p;
+        }
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones.
+    void removeExited() {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = 0; i < slots_.size();) {
+            if (slots_[i].pid == 0 || slots_[i].seen == generation_) {
+                i++;
+                continue;
+            }
+            size_t hole = i;
+            for (size_t j = (hole + 1) & mask; slots_[j].pid != 0; j = (j + 1) & mask) {
+                size_t h = home(slots_[j].pid);
+                // Move j into the hole unless its home lies cyclically in (hole, j].
+                bool stays = hole <= j ? (hole < h && h <= j) : (hole < h || h <= j);
+                if (!stays) {
+                    slots_[hole] = slots_[j];
+                    hole = j;
+                }
+            }
+            slots_[hole] = Process();
+            count_--;
+            // Slot i now holds a shifted entry (or is empty); check it again.
+        }
+    }
+
+    int procFd_ = -1;
+    double hz_ = 100;
+    double pageSize_ = 4096;
+    std::vector<char> dents_;
+    std::vector<uint32_t> pids_;
+
+    std::unique_ptr<ScanPool> pool_;
+    std::vector<std::vector<Reading>> readings_; // per worker
+    const ScanPool::Fn readOne_ = [this](size_t worker, size_t item) {
+        Reading r;
+        if (read(pids_[item], r)) readings_[worker].push_back(r);
+    };
+
+    std::vector<Process> slots_; // size is a power of two
+    size_t count_ = 0;
+    uint64_t generation_ = 0;
+    std::chrono::steady_clock::time_point lastScan_;
+    double elapsed_ = 0;
+    double scanMs_ = 0;
+    uint64_t bootTicks_ = 0;
+    uint64_t previousBootTicks_ = 0;
+
+    ProcConnector events_;
+    // Filled by the connector thread, swapped out at the start of a scan.
+    std::mutex eventsMutex_;
+    std::vector<uint32_t> forkedPids_;
+    std::vector<Reading> exitReadings_;
+    std::vector<uint32_t> newPids_;
+    std::vector<Reading> finalReadings_;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "sampler.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
+
+// Renders a snapshot in the Prometheus text exposition format (0.0.4), as
+// a visitMetrics() visitor. Every metric is a gauge named "monitor_" plus
+// its stream name; array elements are labelled as described by
+// ArrayLabels, or by position.
+class PrometheusWriter {
+public:
+    PrometheusWriter(std::string& out, const std::vector<ArrayLabels>& labels)
+        : out_(out), labels_(labels) {}
+
+    void scalar(const char* name, double value, int decimals) {
+        header(name);
+        out_ += Prefix;
+        out_ += name;
+        out_ += ' ';
+        number(value, decimals);
+        out_ += '\n';
+    }
+
+    template <class T>
+    void array(const char* name, const std::vector<T>& values, int decimals) {
+        if (values.empty()) return;
+        header(name);
+        const ArrayLabels* l = find(name);
+        const char* label = l ? l->label : "index";
+        for (size_t i = 0; i < values.size(); i++) {
+            out_ += Prefix;
+            out_ += name;
+            out_ += '{';
+            out_ += label;
+            out_ += "=\"";
+            if (l && l->names && i < l->names->size()) escape((*l->names)[i]);
+            else integer(i);
+            out_ += '"';
+            if (l && l->pids && i < l->pids->size()) {
+                out_ += ",pid=\"";
+                integer((*l->pids)[i]);
+                out_ += '"';
+            }
+            out_ += "} ";
+            number((double)values[i], decimals);
+            out_ += '\n';
+        }
+    }
+
+private:
+    static constexpr const char* Prefix = "monitor_";
+
+    void header(const char* name) {
+        out_ += "# TYPE ";
+        out_ += Prefix;
+        out_ += name;
+        out_ += " gauge\n";
+    }
+
+    // Longest matching prefix, as in alert rules.
+    const ArrayLabels* find(const char* name) const {
+        const ArrayLabels* best = nullptr;
+        size_t bestLen = 0;
+        for (const ArrayLabels& l : labels_) {
+            size_t len = strlen(l.prefix);
+            if (len > bestLen && strncmp(name, l.prefix, len) == 0) {
+                best = &l;
+                bestLen = len;
+            }
+        }
+        return best;
+    }
+
+    void number(double v, int decimals) {
+        if (std::isnan(v)) {
+            out_ += "NaN";
+            return;
+        }
+        char buf[64];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, decimals);
+        out_.append(buf, r.ptr);
+    }
+
+    void integer(size_t v) {
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        out_.append(buf, r.ptr);
+    }
+
+    // Label values escape backslash, double quote and newline.
+    void escape(const std::string& s) {
+        for (char c : s) {
+            if (c == '\\' || c == '"') out_ += '\\';
+            if (c == '\n') {
+                out_ += "\\n";
+                continue;
+            }
+            out_ += c;
+        }
+    }
+
+    std::string& out_;
+    const std::vector<ArrayLabels>& labels_;
+};
+
+// The /metrics body of the latest snapshot. The first scrape after a tick
+// renders it (and compresses it, if asked for gzip) while concurrent
+// scrapes wait; every scrape of that tick then shares the same buffer.
+class ExpositionCache {
+public:
+    using Body = std::shared_ptr<const std::string>;
+    using Render = std::function<void(const Snapshot&, std::string&)>;
+
+    explicit ExpositionCache(Render render) : render_(std::move(render)) {}
+
+    Body text(const SnapshotPtr& snap) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return textLocked(snap);
+    }
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    Body gzip(const SnapshotPtr& snap) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Body text = textLocked(snap);
+        if (gzipSeq_ == seq_ && gzip_) return gzip_;
+
+        auto out = std::make_shared<std::string>();
+        z_stream zs{};
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return nullptr;
+        }
+        out->resize(deflateBound(&zs, (uLong)text->size()));
+        zs.next_in = (Bytef*)text->data();
+        zs.avail_in = (uInt)text->size();
+        zs.next_out = (Bytef*)out->data();
+        zs.avail_out = (uInt)out->size();
+        int rc = deflate(&zs, Z_FINISH);
+        out->resize(zs.total_out);
+        deflateEnd(&zs);
+        if (rc != Z_STREAM_END) return nullptr;
+
+        gzip_ = std::move(out);
+        gzipSeq_ = seq_;
+        return gzip_;
+    }
+#endif
+
+private:
+    Body textLocked(const SnapshotPtr& snap) {
+        if (text_ && seq_ == snap->seq) return text_;
+        auto out = std::make_shared<std::string>();
+        out->reserve(lastSize_ + lastSize_ / 8);
+        render_(*snap, *out);
+        lastSize_ = out->size();
+        text_ = std::move(out);
+        seq_ = snap->seq;
+        return text_;
+    }
+
+    Render render_;
+    std::mutex mutex_;
+    uint64_t seq_ = 0;
+    Body text_;
+    size_t lastSize_ = 0;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    uint64_t gzipSeq_ = 0;
+    Body gzip_;
+#endif
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Log-scale histogram for estimating quantiles of the samples in one open
+// bucket. Bins grow by ~15% each, covering 1e-3 .. 1e13 with about ±7%
+// relative error; smaller values (including the -1 "unavailable" marker)
+// share bin 0.
+class QuantileSketch {
+public:
+    static constexpr int Bins = 256;
+
+    void add(double v) {
+        counts_[bin(v)]++;
+        total_++;
+    }
+
+    void clear() {
+        counts_.fill(0);
+        total_ = 0;
+    }
+
+    double quantile(double q) const {
+        if (total_ == 0) return 0;
+        uint32_t rank = (uint32_t)std::ceil(q * total_);
+        uint32_t seen = 0;
+        for (int b = 0; b < Bins; b++) {
+            seen += counts_[b];
+            if (seen >= rank) return value(b);
+        }
+        return value(Bins - 1);
+    }
+
+private:
+    static constexpr double MinValue = 1e-3;
+    static constexpr double Decades = 16;
+
+    static int bin(double v) {
+        if (!(v > MinValue)) return 0;
+        int b = 1 + (int)(std::log10(v / MinValue) * (Bins - 1) / Decades);
+        return std::min(b, Bins - 1);
+    }
+
+    // Geometric midpoint of a bin.
+    static double value(int b) {
+        if (b == 0) return 0;
+        return MinValue * std::pow(10.0, (b - 0.5) * Decades / (Bins - 1));
+    }
+
+    std::array<uint32_t, Bins> counts_{};
+    uint32_t total_ = 0;
+};
+
+// One resolution of rolled-up history: a ring of fixed-width buckets holding
+// min, max, mean and p95 of every column. Each raw sample updates the open
+// bucket in O(1); a full bucket is written to the ring when the next one
+// starts. Queries see the open bucket too, so the latest minute or hour is
+// never missing.
+class RollupTier {
+public:
+    RollupTier(const char* name, int64_t widthMs, size_t rows, size_t columns)
+        : name_(name), widthMs_(widthMs), rows_(rows), columns_(columns),
+          starts_(rows), counts_(rows),
+          min_(rows * columns), max_(rows * columns),
+          mean_(rows * columns), p95_(rows * columns),
+          open_(columns) {}
+
+    const char* name() const { return name_; }
+    int64_t widthMs() const { return widthMs_; }
+    int64_t retentionMs() const { return widthMs_ * (int64_t)rows_; }
+
+    void add(int64_t ts, const double* values) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t start = ts - ts % widthMs_;
+        if (openCount_ > 0 && start != openStart_) close();
+        openStart_ = start;
+        openCount_++;
+
+        for (size_t c = 0; c < columns_; c++) {
+            Open& o = open_[c];
+            double v = values[c];
+            if (openCount_ == 1 || v < o.min) o.min = v;
+            if (openCount_ == 1 || v > o.max) o.max = v;
+            o.sum += v;
+            o.sketch.add(v);
+        }
+    }
+
+    // Buckets of `stepMs` (a multiple of the tier width works best) over
+    // [from, to]. Mean is count-weighted; p95 of merged buckets is the
+    // largest p95 among them, an upper bound on the true value.
+    struct Series {
+        std::vector<int64_t> timestamps;
+        std::vector<std::vector<double>> min, max, mean, p95; // [column][bucket]
+    };
+
+    Series query(int64_t from, int64_t to, int64_t stepMs) const {
+        Series out;
+        out.min.resize(columns_);
+        out.max.resize(columns_);
+        out.mean.resize(columns_);
+        out.p95.resize(columns_);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = std::min<uint64_t>(written_, rows_);
+        uint64_t oldest = written_ - n;
+
+        std::vector<double> mn(columns_), mx(columns_), sum(columns_), p(columns_);
+        uint64_t count = 0;
+        int64_t bucket = 0;
+
+        auto emit = [&] {
+            if (count == 0) return;
+            out.timestamps.push_back(bucket);
+            for (size_t c = 0; c < columns_; c++) {
+                out.min[c].push_back(mn[c]);
+                out.max[c].push_back(mx[c]);
+                out.mean[c].push_back(sum[c] / count);
+                out.p95[c].push_back(p[c]);
+            }
+            count = 0;
+        };
+
+        // Merges one bucket starting at `ts`; cell(c) gives column c's
+        // min, max, mean and p95.
+        auto merge = [&](int64_t ts, uint32_t rowCount, auto cell) {
+            int64_t b = from + (ts - from) / stepMs * stepMs;
+            if (count > 0 && b != bucket) emit();
+            bucket = b;
+
+            for (size_t c = 0; c < columns_; c++) {
+                auto [lo, hi, mean, p95] = cell(c);
+                bool first = count == 0;
+                mn[c] = first ? lo : std::min(mn[c], lo);
+                mx[c] = first ? hi : std::max(mx[c], hi);
+                sum[c] = (first ? 0 : sum[c]) + mean * rowCount;
+                p[c] = first ? p95 : std::max(p[c], p95);
+            }
+            count += rowCount;
+        };
+
+        for (uint64_t i = oldest; i < written_; i++) {
+            size_t r = i % rows_;
+            int64_t ts = starts_[r];
+            if (ts < from) continue;
+            if (ts > to) break;
+            merge(ts, counts_[r], [&](size_t c) {
+                size_t cell = c * rows_ + r;
+                return std::array<double, 4>{min_[cell], max_[cell], mean_[cell], p95_[cell]};
+            });
+        }
+        if (openCount_ > 0 && openStart_ >= from && openStart_ <= to) {
+            merge(openStart_, openCount_, [&](size_t c) {
+                const Open& o = open_[c];
+                return std::array<double, 4>{o.min, o.max, o.sum / openCount_, o.sketch.quantile(0.95)};
+            });
+        }
+        emit();
+        return out;
+    }
+
+private:
+    struct Open {
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        QuantileSketch sketch;
+    };
+
+    // Caller holds the lock.
+    void close() {
+        size_t r = written_ % rows_;
+        starts_[r] = openStart_;
+        counts_[r] = openCount_;
+        for (size_t c = 0; c < columns_; c++) {
+            Open& o = open_[c];
+            size_t cell = c * rows_ + r;
+            min_[cell] = (float)o.min;
+            max_[cell] = (float)o.max;
+            mean_[cell] = (float)(o.sum / openCount_);
+            p95_[cell] = (float)o.sketch.quantile(0.95);
+            o.sum = 0;
+            o.sketch.clear();
+        }
+        written_++;
+        openCount_ = 0;
+    }
+
+    const char* name_;
+    int64_t widthMs_;
+    size_t rows_;
+    size_t columns_;
+
+    // Closed buckets, columnar: cell = column * rows + row. The lock also
+    // covers the open bucket, which queries read.
+    mutable std::mutex mutex_;
+    std::vector<int64_t> starts_;
+    std::vector<uint32_t> counts_;
+    std::vector<float> min_, max_, mean_, p95_;
+    uint64_t written_ = 0;
+
+    // Bucket being filled by the sampler thread.
+    std::vector<Open> open_;
+    int64_t openStart_ = 0;
+    uint32_t openCount_ = 0;
+};
+
+// 1 s / 10 s / 1 min / 1 h tiers, each fed directly from raw samples.
+// Together they keep 30 days of every scalar metric in 23,040 buckets of
+// 16 bytes per column: about 26 MB for 70 columns.
+class Rollups {
+public:
+    explicit Rollups(size_t columns) {
+        tiers_.emplace_back(new RollupTier("1s", 1000, 3600, columns));           // 1 hour
+        tiers_.emplace_back(new RollupTier("10s", 10 * 1000, 8640, columns));     // 1 day
+        tiers_.emplace_back(new RollupTier("1m", 60 * 1000, 10080, columns));     // 7 days
+        tiers_.emplace_back(new RollupTier("1h", 3600 * 1000, 720, columns));     // 30 days
+    }
+
+    void add(int64_t ts, const double* values) {
+        for (auto& tier : tiers_) tier->add(ts, values);
+    }
+
+    // Coarsest tier whose buckets are no wider than `stepMs` and that still
+    // holds data `ageMs` old. When none does, the finest coarser tier that
+    // reaches back far enough, and failing that the coarsest tier.
+    const RollupTier* pick(int64_t stepMs, int64_t ageMs) const {
+        const RollupTier* best = nullptr;
+        for (auto& tier : tiers_) {
+            if (tier->widthMs() <= stepMs && tier->retentionMs() >= ageMs) best = tier.get();
+        }
+        if (best) return best;
+        for (auto& tier : tiers_) {
+            if (tier->widthMs() > stepMs && tier->retentionMs() >= ageMs) return tier.get();
+        }
+        return tiers_.back().get();
+    }
+
+private:
+    std::vector<std::unique_ptr<RollupTier>> tiers_;
+};
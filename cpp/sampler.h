@@ -0,0 +1,592 @@
+#pragma once
+
+#include "bin_codec.h"
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Host memory read once per tick. Values are in bytes; fields a platform
+// does not report stay 0.
+struct MemoryStats {
+    double total = 0;
+    double used = 0;
+    double totalVirtual = 0;
+    double usedVirtual = 0;
+
+    double available = 0;
+    double cached = 0;
+    double buffers = 0;
+    double slab = 0;
+    double dirty = 0;
+    double writeback = 0;
+};
+
+// Processes ranked by one metric, highest first. All vectors have the same
+// length.
+struct ProcessRanking {
+    std::vector<uint32_t> pid;
+    std::vector<std::string> name;
+    std::vector<float> cpu;  // percent of one core
+    std::vector<double> rss; // bytes
+    // Delay accounting: percent of wall time spent runnable but waiting for
+    // a CPU, on block I/O, on swap-in and in direct reclaim. 0 when the
+    // kernel does not account delays.
+    std::vector<float> cpuDelay;
+    std::vector<float> ioDelay;
+    std::vector<float> swapDelay;
+    std::vector<float> reclaimDelay;
+};
+
+// Per-device I/O rates over the interval since the previous read. All
+// vectors have one entry per whole disk.
+struct DiskStats {
+    std::vector<std::string> name;
+    std::vector<float> readIops;
+    std::vector<float> writeIops;
+    std::vector<double> readBytes;  // per second
+    std::vector<double> writeBytes; // per second
+    std::vector<float> awaitMs;     // average time per completed request
+    std::vector<float> util;        // percent of time with I/O in flight
+};
+
+// Per-interface rates, per second, over the interval since the previous
+// read. All vectors have one entry per interface; loopback is left out.
+struct NetStats {
+    std::vector<std::string> name;
+    std::vector<double> rxBytes;
+    std::vector<double> txBytes;
+    std::vector<double> rxPackets;
+    std::vector<double> txPackets;
+    std::vector<double> rxErrors;
+    std::vector<double> txErrors;
+    std::vector<double> rxDrops;
+    std::vector<double> txDrops;
+};
+
+// TCP socket counts from one sock_diag dump, refreshed on a slower interval
+// than the snapshots that share it.
+struct TcpSummary {
+    // Indexed by kernel TCP state: 1 established ... 11 closing.
+    static constexpr int StateCount = 12;
+    uint32_t states[StateCount] = {};
+    // Listening sockets whose accept queue is over its limit (dropping).
+    uint32_t listenersFull = 0;
+    // Listeners with the fullest accept queues, fullest first.
+    std::vector<uint32_t> listenPort;
+    std::vector<uint32_t> listenQueue;
+    std::vector<uint32_t> listenBacklog;
+    double dumpMs = 0;
+};
+
+// TCP and UDP protocol counters as per-second rates.
+struct ProtocolRates {
+    double tcpOutSegs = 0;
+    double tcpRetrans = 0;
+    double tcpRetransPercent = 0; // retransmitted share of sent segments
+    double tcpInErrors = 0;
+    double tcpOutResets = 0;
+    double tcpEstabResets = 0;
+    double tcpAttemptFails = 0;
+    double tcpListenOverflows = 0;
+    double tcpListenDrops = 0;
+    double tcpTimeouts = 0;
+    double udpInDatagrams = 0;
+    double udpInErrors = 0;
+    double udpRcvbufErrors = 0;
+    double udpSndbufErrors = 0;
+    double udpNoPorts = 0;
+};
+
+// Per-cgroup usage, one entry per cgroup down to the configured depth. A
+// parent's figures include all of its descendants.
+struct CgroupStats {
+    std::vector<std::string> path; // relative to the cgroup root
+    std::vector<float> cpu;         // percent of one core
+    std::vector<double> memory;     // bytes
+    std::vector<double> memoryAnon;
+    std::vector<double> memoryFile;
+    std::vector<double> ioRead;     // bytes per second
+    std::vector<double> ioWrite;
+    std::vector<uint32_t> pids;
+    // Percent of the interval in which some tasks in the cgroup stalled.
+    std::vector<float> cpuPressure;
+    std::vector<float> memoryPressure;
+    std::vector<float> ioPressure;
+};
+
+// Host-wide pressure stall information: percent of the interval in which
+// some, or all, non-idle tasks were stalled waiting for a resource.
+struct PressureStats {
+    double cpuSome = 0;
+    double cpuFull = 0;
+    double memorySome = 0;
+    double memoryFull = 0;
+    double ioSome = 0;
+    double ioFull = 0;
+};
+
+// The monitor's own cgroup measured against its limits. Limits are the
+// tightest of the cgroup and its ancestors, or the host's when none is set.
+struct ContainerStats {
+    double cpuLimit = 0;         // cores
+    double cpu = 0;              // percent of cpuLimit
+    double throttledMs = 0;      // time throttled per second
+    double throttledPeriods = 0; // percent of quota periods throttled
+    double memoryLimit = 0;      // bytes
+    double memoryUsed = 0;       // working set: usage less inactive page cache
+};
+
+// Identifies the elements of the array metrics whose names start with
+// `prefix`: "disk_" metrics are per snap.disks.name, and so on. Gives alert
+// rule keys and exported labels one shared mapping. Arrays without names
+// (per-core rows) are identified by position.
+struct ArrayLabels {
+    const char* prefix;
+    const char* label;                        // Prometheus label name
+    const std::vector<std::string>* names;    // null: label is the position
+    const std::vector<uint32_t>* pids = nullptr;
+};
+
+// One immutable sample of every metric. Built once per tick by the sampler
+// and shared read-only by every subscriber.
+struct Snapshot {
+    uint64_t seq = 0;
+    std::chrono::steady_clock::time_point taken;
+    // Wall-clock time of the sample, in milliseconds since the Unix epoch.
+    int64_t timestampMs = 0;
+
+    // Why this snapshot was taken: the history period came up, and/or the
+    // stream intervals (in ms) whose subscribers it is for.
+    bool historyDue = false;
+    std::vector<uint32_t> intervals;
+    // Bit i set when collector i was due; the others carry their previous
+    // values over.
+    uint32_t collectorsDue = 0;
+
+    bool dueFor(uint32_t intervalMs) const {
+        return std::find(intervals.begin(), intervals.end(), intervalMs) != intervals.end();
+    }
+
+    // CPU percentages over the history period; history, alerts and
+    // /metrics use these.
+    double cpu = 0;
+    double cpuProcess = 0;
+    double cpuIoWait = 0;
+    double cpuSteal = 0;
+    std::vector<float> coreBusy;
+    std::vector<float> coreSteal;
+    MemoryStats memory;
+    double processRam = 0;
+    double processVirtualRam = 0;
+    ProcessRanking topCpu;
+    ProcessRanking topRss;
+    double processScanMs = 0; // wall time of the /proc/[pid] sweep
+    DiskStats disks;
+    NetStats net;
+    std::shared_ptr<const TcpSummary> tcp; // null until the first dump
+    ProtocolRates protocols;
+    CgroupStats cgroups;
+    ContainerStats container;
+    PressureStats pressure;
+
+    // The same CPU percentages over each due stream interval, so a 1 s
+    // subscriber gets a 1 s figure even on ticks a 100 ms interval shares.
+    // `sse` is that interval's frame; `fields` replaces the CPU pieces of
+    // the shared ones below, by field index.
+    struct CpuWindow {
+        uint32_t intervalMs = 0;
+        double cpu = 0;
+        double cpuProcess = 0;
+        double cpuIoWait = 0;
+        double cpuSteal = 0;
+        std::string sse;
+        std::vector<std::pair<uint16_t, std::string>> fields;
+    };
+    std::vector<CpuWindow> cpuWindows;
+
+    // Pre-serialized "data: ...\n\n" SSE frame, written as-is to every sink.
+    std::string sse;
+    // The same fields serialized one by one as "name":value, for frames that
+    // carry only some of them: field i is fields[fieldEnds[i], fieldEnds[i + 1]).
+    std::string fields;
+    std::vector<uint32_t> fieldEnds;
+
+    const CpuWindow* cpuWindow(uint32_t intervalMs) const {
+        for (const CpuWindow& w : cpuWindows) {
+            if (w.intervalMs == intervalMs) return &w;
+        }
+        return nullptr;
+    }
+
+    // The SSE frame for subscribers on `intervalMs`.
+    const std::string& sseFor(uint32_t intervalMs) const {
+        const CpuWindow* w = cpuWindow(intervalMs);
+        return w ? w->sse : sse;
+    }
+
+    // Appends field i as "name":value, with `w`'s CPU figures if given.
+    void appendField(std::string& out, size_t i, const CpuWindow* w) const {
+        if (w) {
+            for (auto& piece : w->fields) {
+                if (piece.first == i) {
+                    out += piece.second;
+                    return;
+                }
+            }
+        }
+        out.append(fields, fieldEnds[i], fieldEnds[i + 1] - fieldEnds[i]);
+    }
+
+    // Binary stream frames (see bin_codec.h): schema plus absolute values for
+    // subscribers that are starting or resyncing, and per due interval the
+    // change since the previous snapshot for that interval.
+    std::string binKey;
+    std::vector<BinaryDelta> binDeltas;
+
+    // The key frame for binary subscribers on `intervalMs`.
+    const std::string& binKeyFor(uint32_t intervalMs) const {
+        for (const BinaryDelta& d : binDeltas) {
+            if (d.intervalMs == intervalMs && !d.key.empty()) return d.key;
+        }
+        return binKey;
+    }
+
+    // The frame for a binary subscriber on `intervalMs` whose last frame was
+    // snapshot `lastSeq`: a delta if it has that interval's baseline, else
+    // the key frame.
+    const std::string& binFrame(uint32_t intervalMs, uint64_t lastSeq) const {
+        for (const BinaryDelta& d : binDeltas) {
+            if (d.intervalMs != intervalMs) continue;
+            if (lastSeq != 0 && d.baseSeq == lastSeq) return d.frame;
+            return d.key.empty() ? binKey : d.key;
+        }
+        return binKey;
+    }
+};
+
+using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+// Publish/subscribe point between the sampler and the stream handlers.
+// Publishing is O(1) regardless of how many subscribers are waiting.
+class MetricsHub {
+public:
+    using Listener = std::function<void()>;
+
+    void publish(SnapshotPtr snap) {
+        std::vector<Listener> listeners;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            latest_ = std::move(snap);
+            listeners = listeners_;
+        }
+        cond_.notify_all();
+        for (auto& listener : listeners) listener();
+    }
+
+    // An out-of-band SSE frame, such as a pressure trigger firing, for
+    // subscribers to send right away instead of with the next snapshot.
+    struct Event {
+        uint64_t seq;
+        std::shared_ptr<const std::string> frame;
+    };
+
+    void publishEvent(std::string frame) {
+        std::vector<Listener> listeners;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.push_back({++eventSeq_, std::make_shared<const std::string>(std::move(frame))});
+            if (events_.size() > MaxEvents) events_.pop_front();
+            listeners = listeners_;
+        }
+        for (auto& listener : listeners) listener();
+    }
+
+    // Events published after `seq`, oldest first. Only the last MaxEvents
+    // are kept for subscribers that fall behind.
+    std::vector<Event> eventsSince(uint64_t seq) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Event> out;
+        for (const Event& e : events_) {
+            if (e.seq > seq) out.push_back(e);
+        }
+        return out;
+    }
+
+    uint64_t eventSeq() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return eventSeq_;
+    }
+
+    // Registers a callback run after every publish, on the publishing
+    // thread. It must not block; event loops use it to wake themselves up.
+    void addListener(Listener listener) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners_.push_back(std::move(listener));
+    }
+
+    SnapshotPtr latest() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return latest_;
+    }
+
+    // Stream intervals subscribers asked for, in ms, counted per subscriber.
+    // The sampler takes a snapshot on each registered interval; subscribers
+    // with the same interval share it.
+    void addInterval(uint32_t ms) {
+        Listener listener;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (intervals_[ms]++ > 0) return;
+            intervalsVersion_++;
+            listener = intervalListener_;
+        }
+        if (listener) listener();
+    }
+
+    void removeInterval(uint32_t ms) {
+        Listener listener;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = intervals_.find(ms);
+            if (it == intervals_.end() || --it->second > 0) return;
+            intervals_.erase(it);
+            intervalsVersion_++;
+            listener = intervalListener_;
+        }
+        if (listener) listener();
+    }
+
+    // Sets the callback run whenever the interval set changes, on the
+    // subscriber's thread; the sampler uses it to re-arm its timers without
+    // waiting for its next one. An empty listener removes it.
+    void setIntervalListener(Listener listener) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        intervalListener_ = std::move(listener);
+    }
+
+    // The registered intervals, if the set changed since `version`.
+    bool intervalsSince(uint64_t& version, std::vector<uint32_t>& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (version == intervalsVersion_) return false;
+        version = intervalsVersion_;
+        out.clear();
+        for (auto& entry : intervals_) out.push_back(entry.first);
+        return true;
+    }
+
+    // Blocks until a snapshot newer than `seq` is available. Returns nullptr
+    // once the hub has been stopped.
+    SnapshotPtr waitNext(uint64_t seq) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] {
+            return stopped_ || (latest_ && latest_->seq > seq);
+        });
+        if (stopped_) return nullptr;
+        return latest_;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        cond_.notify_all();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    SnapshotPtr latest_;
+    std::vector<Listener> listeners_;
+    bool stopped_ = false;
+
+    static constexpr size_t MaxEvents = 16;
+    std::deque<Event> events_;
+    uint64_t eventSeq_ = 0;
+
+    std::map<uint32_t, uint32_t> intervals_;
+    uint64_t intervalsVersion_ = 0;
+    Listener intervalListener_;
+};
+
+// Dedicated thread that fills a Snapshot whenever someone needs one: every
+// history period, and on every stream interval registered with the hub.
+// All of them are timers on one wheel with absolute deadlines aligned to
+// multiples of their period from a shared epoch, so equal periods fire on
+// the same tick, a 1 s interval lines up with 500 ms and 100 ms ones, and
+// late wake-ups do not accumulate into drift.
+//
+// Collectors may have their own, slower interval; between their ticks a
+// snapshot carries the previous values over. A collector with interval 0
+// runs for every snapshot.
+class Sampler {
+public:
+    using Collect = std::function<void(Snapshot&, const Snapshot* previous)>;
+
+    static constexpr std::chrono::milliseconds Tick{10};
+    static constexpr std::chrono::milliseconds MinInterval{100};
+    static constexpr std::chrono::milliseconds MaxInterval{3600000};
+
+    Sampler(MetricsHub& hub, std::chrono::milliseconds historyPeriod, Collect collect,
+            std::vector<std::chrono::milliseconds> collectorIntervals = {})
+        : hub_(hub), period_(historyPeriod), collect_(std::move(collect)),
+          collectorIntervals_(std::move(collectorIntervals)) {}
+
+    ~Sampler() { stop(); }
+
+    void start() {
+        running_ = true;
+        hub_.setIntervalListener([this] { wake(); });
+        thread_ = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        hub_.setIntervalListener(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            running_ = false;
+        }
+        wakeCond_.notify_one();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // Parses "100ms", "1s", "10s" or a bare number of milliseconds, rounded
+    // to the tick and clamped to [MinInterval, MaxInterval]. Returns
+    // `fallback` for an empty or malformed value.
+    static std::chrono::milliseconds parseInterval(const std::string& text, std::chrono::milliseconds fallback) {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || !(value > 0)) return fallback;
+        std::string unit(end);
+        if (unit == "s") value *= 1000;
+        else if (unit != "ms" && !unit.empty()) return fallback;
+
+        long long ms = llround(value / Tick.count()) * Tick.count();
+        return std::chrono::milliseconds(std::clamp<long long>(ms, MinInterval.count(), MaxInterval.count()));
+    }
+
+private:
+    // Timer tags: kind in the high half, interval or collector in the low.
+    enum Kind : uint64_t { History, Interval, Collector };
+
+    static uint64_t tag(Kind kind, uint32_t value) { return (uint64_t)kind << 32 | value; }
+
+    TimerWheel::Id arm(std::chrono::milliseconds period, uint64_t tag) {
+        uint64_t ticks = std::max<uint64_t>(1, (uint64_t)(period / Tick));
+        return wheel_.add((wheel_.now() / ticks + 1) * ticks, ticks, tag);
+    }
+
+    // Cuts the sampler's sleep short, e.g. when the interval set changes.
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            woken_ = true;
+        }
+        wakeCond_.notify_one();
+    }
+
+    void run() {
+        const auto epoch = std::chrono::steady_clock::now();
+        uint32_t everySnapshot = 0;
+        arm(period_, tag(History, 0));
+        for (size_t c = 0; c < collectorIntervals_.size() && c < 32; c++) {
+            if (collectorIntervals_[c].count() > 0) arm(collectorIntervals_[c], tag(Collector, (uint32_t)c));
+            else everySnapshot |= 1u << c;
+        }
+
+        std::map<uint32_t, TimerWheel::Id> streams;
+        uint64_t streamsVersion = 0;
+        std::vector<uint32_t> registered;
+        std::vector<uint64_t> fired;
+
+        SnapshotPtr previous;
+        uint64_t seq = 0;
+        bool historyDue = true;
+        std::vector<uint32_t> due;
+        uint32_t collectorsDue = ~0u;
+
+        while (running_) {
+            if (historyDue || !due.empty()) {
+                auto snap = std::make_shared<Snapshot>();
+                snap->seq = ++seq;
+                snap->taken = std::chrono::steady_clock::now();
+                snap->timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                snap->historyDue = historyDue;
+                snap->intervals = due;
+                snap->collectorsDue = collectorsDue | everySnapshot;
+                collect_(*snap, previous.get());
+                previous = snap;
+                hub_.publish(std::move(snap));
+                collectorsDue = 0;
+            }
+
+            // A newly registered interval starts on its next multiple.
+            if (hub_.intervalsSince(streamsVersion, registered)) {
+                for (auto it = streams.begin(); it != streams.end();) {
+                    if (std::binary_search(registered.begin(), registered.end(), it->first)) {
+                        ++it;
+                    } else {
+                        wheel_.cancel(it->second);
+                        it = streams.erase(it);
+                    }
+                }
+                for (uint32_t ms : registered) {
+                    if (!streams.count(ms)) streams[ms] = arm(std::chrono::milliseconds(ms), tag(Interval, ms));
+                }
+            }
+
+            uint64_t wake = wheel_.nextWake();
+            bool woken;
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex_);
+                woken = wakeCond_.wait_until(lock, epoch + wake * Tick, [this] { return woken_ || !running_; });
+                woken_ = false;
+            }
+            if (!running_) break;
+            uint64_t now = (uint64_t)((std::chrono::steady_clock::now() - epoch) / Tick);
+
+            // Woken early, only the timers already due fire.
+            fired.clear();
+            wheel_.advance(woken ? now : std::max(wake, now), fired);
+            historyDue = false;
+            due.clear();
+            for (uint64_t t : fired) {
+                uint32_t value = (uint32_t)t;
+                switch ((Kind)(t >> 32)) {
+                    case History: historyDue = true; break;
+                    case Interval: due.push_back(value); break;
+                    case Collector: collectorsDue |= 1u << value; break;
+                }
+            }
+            std::sort(due.begin(), due.end());
+            due.erase(std::unique(due.begin(), due.end()), due.end());
+        }
+    }
+
+    MetricsHub& hub_;
+    std::chrono::milliseconds period_;
+    Collect collect_;
+    std::vector<std::chrono::milliseconds> collectorIntervals_;
+    TimerWheel wheel_; // sampler thread only
+    std::atomic<bool> running_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wakeCond_;
+    bool woken_ = false;
+    std::thread thread_;
+};
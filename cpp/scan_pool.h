@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed pool that runs one batch of independent items at a time.
+// Items are split into one contiguous range per worker; a worker that
+// finishes its own range steals chunks from the others, so a few slow items
+// do not hold the whole batch back. The calling thread works as worker 0.
+class ScanPool {
+public:
+    // Runs `fn(worker, item)` for every item of the current batch.
+    using Fn = std::function<void(size_t worker, size_t item)>;
+
+    explicit ScanPool(size_t threads) : ranges_(std::max<size_t>(threads, 1)) {
+        for (size_t w = 1; w < ranges_.size(); w++) {
+            threads_.emplace_back([this, w] { workerLoop(w); });
+        }
+    }
+
+    ~ScanPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    size_t workers() const { return ranges_.size(); }
+
+    // Processes items [0, count) and returns when all are done.
+    void run(size_t count, const Fn& fn) {
+        size_t n = ranges_.size();
+        for (size_t w = 0; w < n; w++) {
+            ranges_[w].next.store(count * w / n, std::memory_order_relaxed);
+            ranges_[w].end = count * (w + 1) / n;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fn_ = &fn;
+            busy_ = n - 1;
+            batch_++;
+        }
+        wake_.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return busy_ == 0; });
+        fn_ = nullptr;
+    }
+
+private:
+    // Items claimed at a time, from a worker's own range or a victim's.
+    static constexpr size_t Chunk = 16;
+
+    struct alignas(64) Range {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+
+    void workerLoop(size_t w) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stopping_ || batch_ != seen; });
+                if (stopping_) return;
+                seen = batch_;
+            }
+
+            work(w);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_ == 0) done_.notify_one();
+        }
+    }
+
+    // Drains the worker's own range, then the others in turn.
+    void work(size_t w) {
+        const Fn& fn = *fn_;
+        for (size_t i = 0; i < ranges_.size(); i++) {
+            Range& r = ranges_[(w + i) % ranges_.size()];
+            for (;;) {
+                size_t begin = r.next.fetch_add(Chunk, std::memory_order_relaxed);
+                if (begin >= r.end) break;
+                size_t end = std::min(begin + Chunk, r.end);
+                for (size_t item = begin; item < end; item++) fn(w, item);
+            }
+        }
+    }
+
+    std::vector<Range> ranges_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const Fn* fn_ = nullptr;
+    size_t busy_ = 0;
+    uint64_t batch_ = 0;
+    bool stopping_ = false;
+};
@@ -0,0 +1,661 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Append-only on-disk metric history, compressed Gorilla style: timestamps
+// as delta-of-deltas, values as XOR against the previous value of the same
+// column. All columns of a sample share one timestamp and are interleaved in
+// a single bit stream.
+//
+// Each segment is one memory-mapped file: a one-page header followed by the
+// bit stream. The header's sample count and bit length are only advanced
+// after the stream up to that point has been synced, so after a crash a
+// segment is valid up to its last flush. Startup only maps existing
+// segments and reads their headers; nothing is decoded until queried.
+//
+// Sealing a segment appends a summary: the sample count and per-column mean
+// of every minute, kept while appending. Queries with steps of a minute or
+// more read it instead of decoding the stream, so a month-long query touches
+// at most 360 summary rows per segment rather than every sample.
+
+// MSB-first bit writer over a fixed buffer.
+class BitWriter {
+public:
+    void reset(uint8_t* base, uint64_t capacityBits, uint64_t pos = 0) {
+        base_ = base;
+        capacity_ = capacityBits;
+        pos_ = pos;
+    }
+
+    uint64_t pos() const { return pos_; }
+    bool fits(uint64_t bits) const { return pos_ + bits <= capacity_; }
+
+    void write(uint64_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            uint8_t& byte = base_[pos_ >> 3];
+            uint8_t mask = (uint8_t)(0x80 >> (pos_ & 7));
+            if ((value >> i) & 1) byte |= mask;
+            else byte &= (uint8_t)~mask;
+            pos_++;
+        }
+    }
+
+private:
+    uint8_t* base_ = nullptr;
+    uint64_t capacity_ = 0;
+    uint64_t pos_ = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* base, uint64_t bits) : base_(base), end_(bits) {}
+
+    bool atEnd() const { return pos_ >= end_; }
+
+    uint64_t read(int bits) {
+        uint64_t v = 0;
+        for (int i = 0; i < bits; i++) {
+            v = (v << 1) | ((base_[pos_ >> 3] >> (7 - (pos_ & 7))) & 1);
+            pos_++;
+        }
+        return v;
+    }
+
+    bool bit() { return read(1) != 0; }
+
+private:
+    const uint8_t* base_;
+    uint64_t end_;
+    uint64_t pos_ = 0;
+};
+
+// Encoder/decoder state shared by the writer and reader, so both sides
+// evolve identically.
+struct GorillaState {
+    int64_t prevTs = 0;
+    int64_t prevDelta = 0;
+    std::vector<uint64_t> prevBits;
+    std::vector<uint8_t> prevLeading;
+    std::vector<uint8_t> prevTrailing;
+    uint64_t samples = 0;
+
+    explicit GorillaState(size_t columns)
+        : prevBits(columns), prevLeading(columns, 0xff), prevTrailing(columns) {}
+
+    // Worst-case size of one sample, to check space before writing.
+    static uint64_t maxBits(size_t columns) { return 64 + 36 + columns * (64 + 13); }
+
+    void encode(BitWriter& w, int64_t ts, const double* values) {
+        if (samples == 0) {
+            w.write((uint64_t)ts, 64);
+        } else {
+            int64_t delta = ts - prevTs;
+            int64_t dod = delta - prevDelta;
+            if (dod == 0) {
+                w.write(0, 1);
+            } else if (dod >= -63 && dod <= 64) {
+                w.write(0b10, 2);
+                w.write((uint64_t)(dod + 63), 7);
+            } else if (dod >= -255 && dod <= 256) {
+                w.write(0b110, 3);
+                w.write((uint64_t)(dod + 255), 9);
+            } else if (dod >= -2047 && dod <= 2048) {
+                w.write(0b1110, 4);
+                w.write((uint64_t)(dod + 2047), 12);
+            } else {
+                w.write(0b1111, 4);
+                w.write((uint64_t)(uint32_t)(int32_t)dod, 32);
+            }
+            prevDelta = delta;
+        }
+        prevTs = ts;
+
+        for (size_t c = 0; c < prevBits.size(); c++) {
+            uint64_t bits;
+            memcpy(&bits, &values[c], sizeof(bits));
+            if (samples == 0) {
+                w.write(bits, 64);
+            } else {
+                encodeXor(w, c, bits ^ prevBits[c]);
+            }
+            prevBits[c] = bits;
+        }
+        samples++;
+    }
+
+    bool decode(BitReader& r, int64_t& ts, double* values) {
+        if (r.atEnd()) return false;
+
+        if (samples == 0) {
+            ts = (int64_t)r.read(64);
+        } else {
+            int64_t dod;
+            if (!r.bit()) dod = 0;
+            else if (!r.bit()) dod = (int64_t)r.read(7) - 63;
+            else if (!r.bit()) dod = (int64_t)r.read(9) - 255;
+            else if (!r.bit()) dod = (int64_t)r.read(12) - 2047;
+            else dod = (int32_t)(uint32_t)r.read(32);
+            prevDelta += dod;
+            ts = prevTs + prevDelta;
+        }
+        prevTs = ts;
+
+        for (size_t c = 0; c < prevBits.size(); c++) {
+            uint64_t bits = samples == 0 ? r.read(64) : prevBits[c] ^ decodeXor(r, c);
+            prevBits[c] = bits;
+            memcpy(&values[c], &bits, sizeof(bits));
+        }
+        samples++;
+        return true;
+    }
+
+private:
+    void encodeXor(BitWriter& w, size_t c, uint64_t x) {
+        if (x == 0) {
+            w.write(0, 1);
+            return;
+        }
+        int leading = std::min(__builtin_clzll(x), 31);
+        int trailing = __builtin_ctzll(x);
+
+        if (prevLeading[c] != 0xff && leading >= prevLeading[c] && trailing >= prevTrailing[c]) {
+            // Fits in the previous meaningful window.
+            int len = 64 - prevLeading[c] - prevTrailing[c];
+            w.write(0b10, 2);
+            w.write(x >> prevTrailing[c], len);
+            return;
+        }
+
+        int len = 64 - leading - trailing;
+        w.write(0b11, 2);
+        w.write((uint64_t)leading, 5);
+        w.write((uint64_t)(len & 63), 6); // 64 is stored as 0
+        w.write(x >> trailing, len);
+        prevLeading[c] = (uint8_t)leading;
+        prevTrailing[c] = (uint8_t)trailing;
+    }
+
+    uint64_t decodeXor(BitReader& r, size_t c) {
+        if (!r.bit()) return 0;
+        if (!r.bit()) {
+            int len = 64 - prevLeading[c] - prevTrailing[c];
+            return r.read(len) << prevTrailing[c];
+        }
+        int leading = (int)r.read(5);
+        int len = (int)r.read(6);
+        if (len == 0) len = 64;
+        int trailing = 64 - leading - len;
+        prevLeading[c] = (uint8_t)leading;
+        prevTrailing[c] = (uint8_t)trailing;
+        return r.read(len) << trailing;
+    }
+};
+
+class SegmentStore {
+public:
+    // Averages per bucket, as MetricHistory::Series.
+    struct Series {
+        std::vector<int64_t> timestamps;
+        std::vector<std::vector<double>> values; // [column][bucket]
+    };
+
+    SegmentStore(std::string dir, std::vector<std::string> columns, std::vector<int> decimals)
+        : dir_(std::move(dir)), columns_(std::move(columns)), decimals_(std::move(decimals)),
+          state_(columns_.size()) {}
+
+    ~SegmentStore() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (active_) seal(entry(active_));
+    }
+
+    // Maps every existing segment and seals one left open by a previous run.
+    // Only headers are read.
+    bool open() {
+        mkdir(dir_.c_str(), 0755);
+        DIR* d = opendir(dir_.c_str());
+        if (!d) return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (dirent* e = readdir(d)) {
+            std::string name = e->d_name;
+            std::string path = dir_ + "/" + name;
+            if (endsWith(name, ".tmp")) {
+                unlink(path.c_str()); // rotation interrupted before rename
+            } else if (endsWith(name, ".seg")) {
+                auto seg = mapSegment(path);
+                if (seg) segments_.push_back(std::move(seg));
+            }
+        }
+        closedir(d);
+
+        std::sort(segments_.begin(), segments_.end(),
+                  [](const auto& a, const auto& b) { return a->header->firstTs < b->header->firstTs; });
+        for (auto& seg : segments_) {
+            if (!seg->header->sealed) seal(seg);
+        }
+        return true;
+    }
+
+    // Appends one sample. Sampler thread only.
+    void append(int64_t ts, const double* values) {
+        size_t columns = columns_.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (active_ && (!writer_.fits(GorillaState::maxBits(columns_.size())) ||
+                        ts - active_->header->firstTs >= SegmentSpanMs)) {
+            seal(entry(active_));
+            active_ = nullptr;
+        }
+        if (!active_ && !create(ts)) return;
+
+        rounded_.resize(columns);
+        for (size_t c = 0; c < columns; c++) rounded_[c] = round(values[c], decimals_[c]);
+
+        state_.encode(writer_, ts, rounded_.data());
+        if (++unflushed_ >= FlushEvery) flush(*active_);
+
+        int64_t minute = ts - ts % SummaryWidthMs;
+        if (summaryCount_ > 0 && minute != summaryStart_) closeSummaryRow();
+        summaryStart_ = minute;
+        summaryCount_++;
+        for (size_t c = 0; c < columns; c++) summarySums_[c] += rounded_[c];
+    }
+
+    // Averages over [from, to] in buckets of `stepMs`, decoding only the
+    // segments that overlap the range. Steps of a minute or more use the
+    // summaries of sealed segments, bucketed by the minute each row starts.
+    // The lock is only held to pick the segments: sealed ones are immutable
+    // and stay mapped while referenced, and the active one's committed bytes
+    // are copied, so decoding never holds up append().
+    Series query(int64_t from, int64_t to, int64_t stepMs) const {
+        struct Part {
+            std::shared_ptr<const Segment> seg;
+            uint64_t samples;
+            uint64_t bits;
+            std::vector<uint8_t> copy; // active segment only
+        };
+        std::vector<Part> parts;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& seg : segments_) {
+                const Header* h = seg->header;
+                if (h->samples == 0 || h->lastTs < from || h->firstTs > to) continue;
+                parts.push_back({seg, h->samples, h->bits, {}});
+                if (seg.get() == active_) parts.back().copy.assign(seg->data, seg->data + (h->bits + 7) / 8);
+            }
+        }
+
+        Series out;
+        out.values.assign(columns_.size(), {});
+
+        std::vector<double> sums(columns_.size());
+        size_t count = 0;
+        int64_t bucket = 0;
+        auto emit = [&] {
+            if (count == 0) return;
+            out.timestamps.push_back(bucket);
+            for (size_t c = 0; c < columns_.size(); c++) {
+                out.values[c].push_back(sums[c] / count);
+                sums[c] = 0;
+            }
+            count = 0;
+        };
+
+        // Summaries sit at the tail of each file; ask for all of them up
+        // front so a cold query reads them in parallel, not one fault at a time.
+        if (stepMs >= SummaryWidthMs) {
+            for (const Part& part : parts) {
+                if (!part.seg->summary) continue;
+                size_t bytes = part.seg->summaryRows * summaryRowBytes(part.seg->header->columns);
+                madvise((void*)part.seg->summary, bytes, MADV_WILLNEED);
+            }
+        }
+
+        for (const Part& part : parts) {
+            // Map the segment's columns onto ours by name.
+            std::vector<int> map = columnMap(*part.seg);
+
+            if (part.seg->summary && stepMs >= SummaryWidthMs) {
+                size_t rowBytes = summaryRowBytes(map.size());
+                for (uint32_t i = 0; i < part.seg->summaryRows; i++) {
+                    const uint8_t* row = part.seg->summary + i * rowBytes;
+                    int64_t ts;
+                    uint32_t n;
+                    memcpy(&ts, row, sizeof(ts));
+                    memcpy(&n, row + 8, sizeof(n));
+                    if (ts < from) continue;
+                    if (ts > to) break;
+
+                    int64_t b = from + (ts - from) / stepMs * stepMs;
+                    if (count > 0 && b != bucket) emit();
+                    bucket = b;
+                    for (size_t c = 0; c < map.size(); c++) {
+                        float mean;
+                        memcpy(&mean, row + 16 + c * sizeof(float), sizeof(mean));
+                        if (map[c] >= 0) sums[map[c]] += (double)mean * n;
+                    }
+                    count += n;
+                }
+                continue;
+            }
+
+            std::vector<double> row(map.size());
+            GorillaState state(map.size());
+            BitReader reader(part.copy.empty() ? part.seg->data : part.copy.data(), part.bits);
+
+            int64_t ts;
+            for (uint64_t i = 0; i < part.samples && state.decode(reader, ts, row.data()); i++) {
+                if (ts < from) continue;
+                if (ts > to) break;
+
+                int64_t b = from + (ts - from) / stepMs * stepMs;
+                if (count > 0 && b != bucket) emit();
+                bucket = b;
+                for (size_t c = 0; c < map.size(); c++) {
+                    if (map[c] >= 0) sums[map[c]] += row[c];
+                }
+                count++;
+            }
+        }
+        emit();
+        return out;
+    }
+
+    // Oldest timestamp on disk, or 0 when empty.
+    int64_t oldest() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& seg : segments_) {
+            if (seg->header->samples > 0) return seg->header->firstTs;
+        }
+        return 0;
+    }
+
+private:
+    static constexpr size_t HeaderSize = 4096;
+    static constexpr size_t SegmentSize = 4 << 20;
+    static constexpr int64_t SegmentSpanMs = 6 * 3600 * 1000;
+    static constexpr int64_t RetentionMs = 30LL * 24 * 3600 * 1000;
+    static constexpr uint32_t FlushEvery = 20;
+    static constexpr int64_t SummaryWidthMs = 60 * 1000;
+    static constexpr uint32_t Version = 2;
+    static constexpr char Magic[8] = {'S', 'M', 'S', 'E', 'G', '0', '1', '\0'};
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t columns;
+        uint64_t capacityBytes;
+        // Committed state; only advanced after the stream has been synced.
+        uint64_t samples;
+        uint64_t bits;
+        int64_t firstTs;
+        int64_t lastTs;
+        uint32_t sealed;
+        uint32_t namesLength;
+        // Version 2: the summary's offset in the file and its row count,
+        // written when the segment is sealed. Version 1 segments have none.
+        uint64_t summaryOffset;
+        uint32_t summaryRows;
+        uint32_t reserved;
+        // NUL-separated column names follow, up to the end of the page.
+    };
+    static constexpr size_t HeaderV1Size = offsetof(Header, summaryOffset);
+
+    // A summary row: int64 minute start, uint32 sample count, 4 bytes of
+    // padding, then one float mean per column.
+    static size_t summaryRowBytes(size_t columns) { return 16 + columns * sizeof(float); }
+
+    static const char* names(const Header* h) {
+        return (const char*)h + (h->version >= 2 ? sizeof(Header) : HeaderV1Size);
+    }
+
+    // Unmapped when the last reference goes, which may be a query still
+    // decoding it after it was sealed or expired.
+    struct Segment {
+        std::string path;
+        void* map = nullptr;
+        size_t length = 0;
+        Header* header = nullptr;
+        uint8_t* data = nullptr;
+        const uint8_t* summary = nullptr; // null when there is none
+        uint32_t summaryRows = 0;
+
+        ~Segment() {
+            if (map) munmap(map, length);
+        }
+    };
+
+    static bool endsWith(const std::string& s, const char* suffix) {
+        size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    static double round(double v, int decimals) {
+        static const double scales[] = {1, 10, 100, 1000, 10000};
+        if (!std::isfinite(v)) return 0;
+        return std::round(v * scales[decimals]) / scales[decimals];
+    }
+
+    std::shared_ptr<Segment> mapSegment(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < HeaderSize) {
+            ::close(fd);
+            return nullptr;
+        }
+
+        void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) return nullptr;
+        // Reading the header must fault in one page, not a readahead window:
+        // a cold start touches every segment.
+        madvise(map, HeaderSize, MADV_RANDOM);
+
+        auto seg = std::make_shared<Segment>();
+        seg->path = path;
+        seg->map = map;
+        seg->length = (size_t)st.st_size;
+        seg->header = (Header*)map;
+        seg->data = (uint8_t*)map + HeaderSize;
+
+        const Header* h = seg->header;
+        if (memcmp(h->magic, Magic, sizeof(Magic)) != 0 ||
+            h->bits > (uint64_t)(seg->length - HeaderSize) * 8) {
+            return nullptr;
+        }
+        if (h->version >= 2 && h->sealed && h->summaryRows > 0 &&
+            h->summaryOffset + (uint64_t)h->summaryRows * summaryRowBytes(h->columns) <= seg->length) {
+            seg->summary = (const uint8_t*)map + h->summaryOffset;
+            seg->summaryRows = h->summaryRows;
+        }
+        return seg;
+    }
+
+    std::shared_ptr<Segment>& entry(const Segment* seg) {
+        return *std::find_if(segments_.begin(), segments_.end(),
+                             [&](const std::shared_ptr<Segment>& s) { return s.get() == seg; });
+    }
+
+    std::vector<int> columnMap(const Segment& seg) const {
+        std::vector<int> map;
+        const char* p = names(seg.header);
+        const char* end = p + seg.header->namesLength;
+        while (p < end && map.size() < seg.header->columns) {
+            std::string name(p);
+            auto it = std::find(columns_.begin(), columns_.end(), name);
+            map.push_back(it == columns_.end() ? -1 : (int)(it - columns_.begin()));
+            p += name.size() + 1;
+        }
+        return map;
+    }
+
+    // Creates a segment under a temporary name and renames it into place once
+    // its header is on disk, so a crash never leaves a half-written header.
+    bool create(int64_t ts) {
+        std::string names;
+        for (auto& c : columns_) names.append(c).push_back('\0');
+        if (sizeof(Header) + names.size() > HeaderSize) return false;
+
+        char file[64];
+        snprintf(file, sizeof(file), "/%020lld.seg", (long long)ts);
+        std::string path = dir_ + file;
+        std::string tmp = path + ".tmp";
+
+        int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, SegmentSize) != 0) {
+            ::close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+
+        Header h{};
+        memcpy(h.magic, Magic, sizeof(Magic));
+        h.version = Version;
+        h.columns = (uint32_t)columns_.size();
+        h.capacityBytes = SegmentSize - HeaderSize;
+        h.firstTs = ts;
+        h.lastTs = ts;
+        h.namesLength = (uint32_t)names.size();
+        std::string page(HeaderSize, '\0');
+        memcpy(&page[0], &h, sizeof(h));
+        memcpy(&page[sizeof(h)], names.data(), names.size());
+
+        bool ok = pwrite(fd, page.data(), page.size(), 0) == (ssize_t)page.size() && fsync(fd) == 0;
+        ::close(fd);
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+
+        auto seg = mapSegment(path);
+        if (!seg) return false;
+
+        active_ = seg.get();
+        segments_.push_back(std::move(seg));
+        writer_.reset(active_->data, (uint64_t)active_->header->capacityBytes * 8);
+        state_ = GorillaState(columns_.size());
+        unflushed_ = 0;
+        summary_.clear();
+        summarySums_.assign(columns_.size(), 0);
+        summaryCount_ = 0;
+        dropExpired(ts);
+        return true;
+    }
+
+    // Syncs the stream, then publishes it by advancing the header.
+    void flush(Segment& seg) {
+        if (unflushed_ == 0) return;
+
+        size_t used = (size_t)((writer_.pos() + 7) / 8);
+        msync(seg.map, HeaderSize + alignUp(used), MS_SYNC);
+
+        seg.header->samples = state_.samples;
+        seg.header->bits = writer_.pos();
+        seg.header->lastTs = state_.prevTs;
+        msync(seg.map, HeaderSize, MS_SYNC);
+        unflushed_ = 0;
+    }
+
+    void closeSummaryRow() {
+        size_t columns = columns_.size();
+        size_t at = summary_.size();
+        summary_.resize(at + summaryRowBytes(columns));
+        uint8_t* row = &summary_[at];
+        memcpy(row, &summaryStart_, sizeof(summaryStart_));
+        memcpy(row + 8, &summaryCount_, sizeof(summaryCount_));
+        for (size_t c = 0; c < columns; c++) {
+            float mean = (float)(summarySums_[c] / summaryCount_);
+            memcpy(row + 16 + c * sizeof(float), &mean, sizeof(mean));
+            summarySums_[c] = 0;
+        }
+        summaryCount_ = 0;
+    }
+
+    // Writes the active segment's summary at `used` and syncs it before the
+    // header points at it. Returns the file's new used length.
+    size_t writeSummary(Segment& seg, size_t used) {
+        if (summaryCount_ > 0) closeSummaryRow();
+        if (summary_.empty()) return used;
+
+        int fd = ::open(seg.path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0) return used;
+        bool ok = pwrite(fd, summary_.data(), summary_.size(), (off_t)used) == (ssize_t)summary_.size() &&
+                  fsync(fd) == 0;
+        ::close(fd);
+        if (!ok) return used;
+
+        seg.header->summaryOffset = used;
+        seg.header->summaryRows = (uint32_t)(summary_.size() / summaryRowBytes(columns_.size()));
+        return used + summary_.size();
+    }
+
+    // Flushes and marks a segment read-only, writing the active one's
+    // summary and trimming the unused tail. A segment left open by a
+    // previous run gets no summary and is always decoded. The old mapping is
+    // only replaced once the trimmed file is mapped; it stays valid for the
+    // used part if remapping fails, and queries still reading it release it
+    // when they finish.
+    void seal(std::shared_ptr<Segment>& seg) {
+        if (seg.get() == active_) flush(*seg);
+        size_t used = HeaderSize + alignUp((size_t)((seg->header->bits + 7) / 8));
+        if (seg.get() == active_) used = writeSummary(*seg, used);
+
+        seg->header->sealed = 1;
+        msync(seg->map, HeaderSize, MS_SYNC);
+
+        if (used != seg->length && truncate(seg->path.c_str(), (off_t)used) == 0) {
+            if (auto remapped = mapSegment(seg->path)) seg = std::move(remapped);
+        }
+    }
+
+    void dropExpired(int64_t now) {
+        auto expired = [&](const std::shared_ptr<Segment>& seg) {
+            if (seg.get() == active_ || seg->header->lastTs >= now - RetentionMs) return false;
+            unlink(seg->path.c_str());
+            return true;
+        };
+        segments_.erase(std::remove_if(segments_.begin(), segments_.end(), expired),
+                        segments_.end());
+    }
+
+    static size_t alignUp(size_t n) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        return (n + page - 1) / page * page;
+    }
+
+    std::string dir_;
+    std::vector<std::string> columns_;
+    std::vector<int> decimals_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<Segment>> segments_;
+    Segment* active_ = nullptr;
+    BitWriter writer_;
+    GorillaState state_;
+    std::vector<double> rounded_;
+    uint32_t unflushed_ = 0;
+
+    // The active segment's summary: closed rows, and the minute being filled.
+    std::vector<uint8_t> summary_;
+    std::vector<double> summarySums_;
+    int64_t summaryStart_ = 0;
+    uint32_t summaryCount_ = 0;
+};
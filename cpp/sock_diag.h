@@ -0,0 +1,161 @@
+#pragma once
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Counts TCP sockets per state with NETLINK_SOCK_DIAG dumps, which return
+// binary records instead of the /proc/net/tcp text the kernel would have to
+// format for every socket.
+class SockDiagReader {
+public:
+    ~SockDiagReader() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool open() {
+        fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+        buf_.resize(1 << 16);
+        return fd_ >= 0;
+    }
+
+    // Dumps IPv4 and IPv6 TCP sockets. Keeps the `topListeners` listening
+    // sockets with the longest accept queues.
+    bool read(TcpSummary& out, size_t topListeners) {
+        auto start = std::chrono::steady_clock::now();
+        listeners_.clear();
+        if (!dump(AF_INET, out) || !dump(AF_INET6, out)) return false;
+
+        // Fullest queues first, relative to their backlog.
+        auto fuller = [](const Listener& a, const Listener& b) {
+            return (uint64_t)a.queue * std::max(b.backlog, 1u) > (uint64_t)b.queue * std::max(a.backlog, 1u);
+        };
+        size_t n = std::min(topListeners, listeners_.size());
+        std::partial_sort(listeners_.begin(), listeners_.begin() + n, listeners_.end(), fuller);
+        for (size_t i = 0; i < n; i++) {
+            out.listenPort.push_back(listeners_[i].port);
+            out.listenQueue.push_back(listeners_[i].queue);
+            out.listenBacklog.push_back(listeners_[i].backlog);
+        }
+
+        out.dumpMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+private:
+    struct Listener {
+        uint16_t port;
+        uint32_t queue;   // connections waiting for accept()
+        uint32_t backlog; // accept queue limit
+    };
+
+    bool dump(uint8_t family, TcpSummary& out) {
+        struct {
+            nlmsghdr header;
+            inet_diag_req_v2 request;
+        } message{};
+        message.header.nlmsg_len = sizeof(message);
+        message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+        message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        message.header.nlmsg_seq = ++seq_;
+        message.request.sdiag_family = family;
+        message.request.sdiag_protocol = IPPROTO_TCP;
+        message.request.idiag_states = ~0u;
+
+        sockaddr_nl kernel{};
+        kernel.nl_family = AF_NETLINK;
+        if (sendto(fd_, &message, sizeof(message), 0, (sockaddr*)&kernel, sizeof(kernel)) < 0) {
+            return false;
+        }
+
+        for (;;) {
+            ssize_t len = recv(fd_, buf_.data(), buf_.size(), 0);
+            if (len <= 0) return false;
+
+            for (nlmsghdr* h = (nlmsghdr*)buf_.data(); NLMSG_OK(h, (size_t)len); h = NLMSG_NEXT(h, len)) {
+                if (h->nlmsg_seq != seq_) continue;
+                if (h->nlmsg_type == NLMSG_DONE) return true;
+                if (h->nlmsg_type == NLMSG_ERROR) return false;
+
+                const inet_diag_msg* m = (const inet_diag_msg*)NLMSG_DATA(h);
+                if (m->idiag_state < TcpSummary::StateCount) out.states[m->idiag_state]++;
+
+                // For listeners, rqueue is the accept queue and wqueue its limit;
+                // the kernel only drops once the queue is over the limit.
+                if (m->idiag_state == TcpListen) {
+                    if (m->idiag_rqueue > m->idiag_wqueue) out.listenersFull++;
+                    listeners_.push_back({ntohs(m->id.idiag_sport), m->idiag_rqueue, m->idiag_wqueue});
+                }
+            }
+        }
+    }
+
+    static constexpr uint8_t TcpListen = 10;
+
+    int fd_ = -1;
+    uint32_t seq_ = 0;
+    std::vector<char> buf_;
+    std::vector<Listener> listeners_;
+};
+
+// Runs SockDiagReader on its own thread and interval, as a dump on a busy
+// host costs far more than the per-tick /proc reads. The sampler picks up
+// whatever summary is newest.
+class TcpStateCollector {
+public:
+    ~TcpStateCollector() { stop(); }
+
+    bool start(std::chrono::milliseconds interval, size_t topListeners) {
+        if (!reader_.open()) return false;
+        thread_ = std::thread([this, interval, topListeners] {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopping_) {
+                lock.unlock();
+                auto summary = std::make_shared<TcpSummary>();
+                bool ok = reader_.read(*summary, topListeners);
+                lock.lock();
+                if (ok) latest_ = std::move(summary);
+                wake_.wait_for(lock, interval, [this] { return stopping_; });
+            }
+        });
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    std::shared_ptr<const TcpSummary> latest() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return latest_;
+    }
+
+private:
+    SockDiagReader reader_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::shared_ptr<const TcpSummary> latest_;
+};
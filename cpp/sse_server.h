@@ -0,0 +1,443 @@
+#pragma once
+
+#include "field_select.h"
+#include "httplib.h"
+#include "sampler.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Serves /metrics/stream subscribers from a single epoll thread. An idle
+// subscriber costs one file descriptor and a handful of frame pointers
+// instead of a parked thread-pool worker. Subscribers are grouped by their
+// ?interval=, and a snapshot is only offered to the groups it was taken for.
+class SseStreamer {
+public:
+    using Frame = std::shared_ptr<const std::string>;
+
+    SseStreamer(MetricsHub& hub, FieldSelector& fields, std::chrono::milliseconds defaultInterval)
+        : hub_(hub), fields_(fields), defaultInterval_(defaultInterval) {}
+
+    ~SseStreamer() { stop(); }
+
+    bool start() {
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd_ < 0 || wakeFd_ < 0) return false;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeFd_;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+        hub_.addListener([this] { wake(); });
+
+        running_ = true;
+        thread_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() {
+        if (!running_.exchange(false)) return;
+        wake();
+        if (thread_.joinable()) thread_.join();
+
+        for (auto& entry : conns_) {
+            close(entry.first);
+            hub_.removeInterval(entry.second.intervalMs);
+        }
+        conns_.clear();
+        groups_.clear();
+        close(epollFd_);
+        close(wakeFd_);
+    }
+
+    // Takes ownership of a connected socket whose request head has already
+    // been consumed. Safe to call from any thread.
+    void adopt(int fd, std::string target) {
+        {
+            std::lock_guard<std::mutex> lock(incomingMutex_);
+            incoming_.emplace_back(fd, std::move(target));
+        }
+        wake();
+    }
+
+    size_t connections() const { return count_; }
+
+private:
+    // Frames not yet fully written to one subscriber. When a client falls
+    // behind by more than this many frames, newer ticks are dropped for it.
+    static constexpr size_t MaxPending = 4;
+
+    struct Conn {
+        std::array<Frame, MaxPending> pending;
+        size_t head = 0;
+        size_t count = 0;
+        size_t offset = 0;
+        bool wantWrite = false;
+        bool binary = false;
+        // Fields picked with ?metrics=; null for all of them.
+        std::shared_ptr<FieldSelection> selection;
+        // Stream interval and position in that interval's group.
+        uint32_t intervalMs = 0;
+        size_t groupPos = 0;
+        // Last snapshot queued for this subscriber. A binary subscriber only
+        // gets a delta when it has its interval's previous snapshot;
+        // otherwise, after a dropped tick, it restarts from a key frame.
+        uint64_t seq = 0;
+    };
+
+    static std::string queryParam(const std::string& target, const char* key) {
+        size_t q = target.find('?');
+        if (q == std::string::npos) return "";
+
+        httplib::Params params;
+        httplib::detail::parse_query_text(target.substr(q + 1), params);
+        auto it = params.find(key);
+        return it != params.end() ? it->second : "";
+    }
+
+    Frame textFrame(const Conn& conn, const SnapshotPtr& snap) {
+        return conn.selection ? conn.selection->frame(snap, conn.intervalMs)
+                              : Frame(snap, &snap->sseFor(conn.intervalMs));
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t n = write(wakeFd_, &one, sizeof(one));
+        (void)n;
+    }
+
+    void run() {
+        std::array<epoll_event, 256> events;
+        uint64_t lastSeq = 0;
+        uint64_t lastEvent = hub_.eventSeq();
+
+        while (running_) {
+            int n = epoll_wait(epollFd_, events.data(), (int)events.size(), -1);
+            if (n < 0 && errno != EINTR) break;
+
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd_) {
+                    uint64_t value;
+                    ssize_t r = read(wakeFd_, &value, sizeof(value));
+                    (void)r;
+                    continue;
+                }
+
+                auto it = conns_.find(fd);
+                if (it == conns_.end()) continue;
+
+                if (events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+                    drop(fd);
+                } else if (events[i].events & EPOLLIN) {
+                    if (!drain(fd)) drop(fd);
+                } else if (events[i].events & EPOLLOUT) {
+                    flush(fd, it->second);
+                }
+            }
+
+            acceptIncoming();
+
+            SnapshotPtr snap = hub_.latest();
+            if (snap && snap->seq != lastSeq) {
+                lastSeq = snap->seq;
+                broadcast(snap);
+            }
+            if (hub_.eventSeq() != lastEvent) {
+                for (const MetricsHub::Event& e : hub_.eventsSince(lastEvent)) {
+                    lastEvent = e.seq;
+                    broadcastEvent(e.frame);
+                }
+            }
+        }
+    }
+
+    void acceptIncoming() {
+        std::vector<std::pair<int, std::string>> incoming;
+        {
+            std::lock_guard<std::mutex> lock(incomingMutex_);
+            incoming.swap(incoming_);
+        }
+
+        static const Frame sseHeader = std::make_shared<const std::string>(
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/event-stream\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: close\r\n"
+            "Access-Control-Allow-Origin: http://localhost\r\n"
+            "\r\n");
+        static const Frame binHeader = std::make_shared<const std::string>(
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: close\r\n"
+            "Access-Control-Allow-Origin: http://localhost\r\n"
+            "\r\n");
+
+        SnapshotPtr snap = hub_.latest();
+        for (auto& entry : incoming) {
+            int fd = entry.first;
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fd;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+
+            Conn& conn = conns_[fd];
+            count_ = conns_.size();
+            conn.binary = queryParam(entry.second, "format") == "bin";
+            if (!conn.binary) conn.selection = fields_.select(queryParam(entry.second, "metrics"));
+            conn.intervalMs = (uint32_t)Sampler::parseInterval(queryParam(entry.second, "interval"),
+                                                               defaultInterval_).count();
+            std::vector<int>& group = groups_[conn.intervalMs];
+            conn.groupPos = group.size();
+            group.push_back(fd);
+            hub_.addInterval(conn.intervalMs);
+            enqueue(conn, conn.binary ? binHeader : sseHeader);
+            if (snap && enqueue(conn, conn.binary ? Frame(snap, &snap->binKeyFor(conn.intervalMs))
+                                                  : textFrame(conn, snap))) {
+                conn.seq = snap->seq;
+            }
+            flush(fd, conn);
+        }
+    }
+
+    void broadcast(const SnapshotPtr& snap) {
+        // Collect first: flush() may drop connections from the map. Each
+        // group gets its interval's frame; binary subscribers its delta,
+        // against the snapshot the group was last sent.
+        std::vector<int> fds;
+        for (uint32_t interval : snap->intervals) {
+            auto group = groups_.find(interval);
+            if (group == groups_.end()) continue;
+            Frame sse(snap, &snap->sseFor(interval));
+            for (int fd : group->second) {
+                Conn& conn = conns_[fd];
+                if (conn.seq >= snap->seq) continue;
+
+                Frame frame = conn.selection ? conn.selection->frame(snap, interval) : !conn.binary ? sse
+                    : Frame(snap, &snap->binFrame(interval, conn.seq));
+                if (!enqueue(conn, frame)) continue;
+
+                conn.seq = snap->seq;
+                fds.push_back(fd);
+            }
+        }
+        for (int fd : fds) {
+            auto it = conns_.find(fd);
+            if (it != conns_.end() && !it->second.wantWrite) flush(fd, it->second);
+        }
+    }
+
+    // Event frames only go to text subscribers; the binary format carries
+    // snapshots alone.
+    void broadcastEvent(const Frame& frame) {
+        std::vector<int> fds;
+        for (auto& entry : conns_) {
+            if (!entry.second.binary && enqueue(entry.second, frame)) fds.push_back(entry.first);
+        }
+        for (int fd : fds) {
+            auto it = conns_.find(fd);
+            if (it != conns_.end() && !it->second.wantWrite) flush(fd, it->second);
+        }
+    }
+
+    static bool enqueue(Conn& conn, const Frame& frame) {
+        if (conn.count == MaxPending) return false;
+        conn.pending[(conn.head + conn.count) % MaxPending] = frame;
+        conn.count++;
+        return true;
+    }
+
+    void flush(int fd, Conn& conn) {
+        while (conn.count > 0) {
+            const std::string& buf = *conn.pending[conn.head];
+            ssize_t n = send(fd, buf.data() + conn.offset, buf.size() - conn.offset,
+                             MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                drop(fd);
+                return;
+            }
+
+            conn.offset += (size_t)n;
+            if (conn.offset == buf.size()) {
+                conn.pending[conn.head].reset();
+                conn.head = (conn.head + 1) % MaxPending;
+                conn.count--;
+                conn.offset = 0;
+            }
+        }
+
+        bool wantWrite = conn.count > 0;
+        if (wantWrite != conn.wantWrite) {
+            conn.wantWrite = wantWrite;
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+            ev.data.fd = fd;
+            epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+        }
+    }
+
+    // Subscribers never send anything after the request; read and discard
+    // so a half-closed socket is noticed. Returns false on EOF or error.
+    static bool drain(int fd) {
+        char buf[512];
+        for (;;) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n > 0) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            return false;
+        }
+    }
+
+    void drop(int fd) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+
+        auto it = conns_.find(fd);
+        if (it != conns_.end()) {
+            // Swap-remove from the interval group, keeping positions current.
+            Conn& conn = it->second;
+            std::vector<int>& group = groups_[conn.intervalMs];
+            int last = group.back();
+            group[conn.groupPos] = last;
+            conns_[last].groupPos = conn.groupPos;
+            group.pop_back();
+            if (group.empty()) groups_.erase(conn.intervalMs);
+            hub_.removeInterval(conn.intervalMs);
+            conns_.erase(it);
+        }
+        count_ = conns_.size();
+    }
+
+    MetricsHub& hub_;
+    FieldSelector& fields_;
+    std::chrono::milliseconds defaultInterval_;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    std::mutex incomingMutex_;
+    std::vector<std::pair<int, std::string>> incoming_;
+
+    // Owned by the epoll thread.
+    std::unordered_map<int, Conn> conns_;
+    std::unordered_map<uint32_t, std::vector<int>> groups_; // interval -> fds
+    std::atomic<size_t> count_{0};
+};
+
+// httplib::Server that hands /metrics/stream connections to an SseStreamer
+// before a worker thread starts serving them. Every other request is
+// processed exactly as httplib::Server does.
+class StreamingServer : public httplib::Server {
+public:
+    explicit StreamingServer(SseStreamer& streamer) : streamer_(streamer) {}
+
+private:
+    static constexpr const char* StreamPath = "/metrics/stream";
+
+    bool process_and_close_socket(socket_t sock) override {
+        std::string target;
+        size_t headLength = 0;
+        if (peekStreamRequest(sock, target, headLength)) {
+            // Consume the request head; the streamer owns the socket now.
+            std::string head(headLength, '\0');
+            if (recv(sock, head.data(), headLength, MSG_WAITALL) == (ssize_t)headLength) {
+                streamer_.adopt(sock, std::move(target));
+                return true;
+            }
+        }
+
+        std::string remote_addr;
+        int remote_port = 0;
+        httplib::detail::get_remote_ip_and_port(sock, remote_addr, remote_port);
+
+        std::string local_addr;
+        int local_port = 0;
+        httplib::detail::get_local_ip_and_port(sock, local_addr, local_port);
+
+        auto ret = httplib::detail::process_server_socket(
+            svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
+            read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
+            write_timeout_usec_,
+            [&](httplib::Stream& strm, bool close_connection, bool& connection_closed) {
+                return process_request(strm, remote_addr, remote_port, local_addr,
+                                       local_port, close_connection, connection_closed,
+                                       nullptr);
+            });
+
+        httplib::detail::shutdown_socket(sock);
+        httplib::detail::close_socket(sock);
+        return ret;
+    }
+
+    // Looks at the first request on the connection without consuming it.
+    // Returns true with the request target and head length when it is a
+    // complete GET for the stream path.
+    bool peekStreamRequest(socket_t sock, std::string& target, size_t& headLength) {
+        static const std::string prefix = std::string("GET ") + StreamPath;
+        char buf[4096];
+        int waitedMs = 0;
+        const int timeoutMs = (int)(read_timeout_sec_ * 1000 + read_timeout_usec_ / 1000);
+
+        for (;;) {
+            pollfd pfd{sock, POLLIN, 0};
+            if (poll(&pfd, 1, timeoutMs) <= 0) return false;
+
+            ssize_t n = recv(sock, buf, sizeof(buf), MSG_PEEK);
+            if (n <= 0) return false;
+
+            size_t len = (size_t)n;
+            size_t cmp = std::min(len, prefix.size());
+            if (memcmp(buf, prefix.data(), cmp) != 0) return false;
+
+            if (len > prefix.size()) {
+                char next = buf[prefix.size()];
+                if (next != ' ' && next != '?') return false;
+
+                const char* end = (const char*)memmem(buf, len, "\r\n\r\n", 4);
+                if (end) {
+                    const char* start = buf + 4;
+                    const char* space = (const char*)memchr(start, ' ', end - start);
+                    if (!space) return false;
+                    target.assign(start, space);
+                    headLength = (size_t)(end - buf) + 4;
+                    return true;
+                }
+            }
+
+            // Head not complete yet; it rarely spans segments, so a short
+            // sleep between peeks is enough.
+            if (len == sizeof(buf) || waitedMs >= timeoutMs) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            waitedMs++;
+        }
+    }
+
+    SseStreamer& streamer_;
+};
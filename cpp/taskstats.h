@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Delay accounting totals of whole processes, fetched over the taskstats
+// generic netlink family. Totals are in nanoseconds since the process
+// started; they stay 0 unless the kernel runs with delay accounting on
+// (delayacct boot option or the kernel.task_delayacct sysctl).
+struct TaskDelays {
+    uint32_t pid = 0;
+    uint64_t cpu = 0;     // runnable, waiting for a CPU
+    uint64_t io = 0;      // waiting for block I/O
+    uint64_t swap = 0;    // waiting for swap-in
+    uint64_t reclaim = 0; // in direct memory reclaim
+};
+
+class TaskstatsClient {
+public:
+    ~TaskstatsClient() { close(); }
+
+    bool open() {
+        fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+        if (fd_ < 0) return false;
+        sockaddr_nl addr{};
+        addr.nl_family = AF_NETLINK;
+        if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0 || !resolveFamily()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    // Fetches the delays of every pid with one send and as few receives as
+    // the replies need. Pids that have exited are left out of `out`.
+    bool query(const std::vector<uint32_t>& pids, std::vector<TaskDelays>& out) {
+        out.clear();
+        if (fd_ < 0 || pids.empty()) return fd_ >= 0;
+
+        // All requests back to back in one buffer; the kernel handles each.
+        request_.clear();
+        for (size_t i = 0; i < pids.size(); i++) {
+            appendRequest(family_, TASKSTATS_CMD_GET, (uint32_t)(seq_ + i),
+                          TASKSTATS_CMD_ATTR_TGID, &pids[i], sizeof(pids[i]));
+        }
+        uint32_t first = seq_;
+        seq_ += (uint32_t)pids.size();
+        if (send(fd_, request_.data(), request_.size(), 0) != (ssize_t)request_.size()) return false;
+
+        size_t pending = pids.size();
+        while (pending > 0) {
+            pollfd p{fd_, POLLIN, 0};
+            if (poll(&p, 1, ReplyTimeoutMs) <= 0) return false;
+            ssize_t len = recv(fd_, reply_, sizeof(reply_), 0);
+            if (len < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            for (nlmsghdr* h = (nlmsghdr*)reply_; NLMSG_OK(h, (size_t)len); h = NLMSG_NEXT(h, len)) {
+                if (h->nlmsg_seq - first >= pids.size()) continue; // stale reply
+                pending--;
+                TaskDelays d;
+                if (h->nlmsg_type == family_ && parseStats(h, d)) out.push_back(d);
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr int ReplyTimeoutMs = 100;
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    void appendRequest(uint16_t family, uint8_t cmd, uint32_t seq,
+                       uint16_t attrType, const void* attr, size_t attrLen) {
+        size_t start = request_.size();
+        size_t len = NLMSG_LENGTH(GENL_HDRLEN + NLA_HDRLEN + attrLen);
+        request_.resize(start + NLMSG_ALIGN(len));
+
+        nlmsghdr* h = (nlmsghdr*)&request_[start];
+        h->nlmsg_len = (uint32_t)len;
+        h->nlmsg_type = family;
+        h->nlmsg_flags = NLM_F_REQUEST;
+        h->nlmsg_seq = seq;
+
+        genlmsghdr* g = (genlmsghdr*)NLMSG_DATA(h);
+        g->cmd = cmd;
+        g->version = 1;
+
+        nlattr* a = (nlattr*)((char*)g + GENL_HDRLEN);
+        a->nla_type = attrType;
+        a->nla_len = (uint16_t)(NLA_HDRLEN + attrLen);
+        memcpy((char*)a + NLA_HDRLEN, attr, attrLen);
+    }
+
+    // Looks up the id of the TASKSTATS family.
+    bool resolveFamily() {
+        request_.clear();
+        appendRequest(GENL_ID_CTRL, CTRL_CMD_GETFAMILY, seq_++, CTRL_ATTR_FAMILY_NAME,
+                      TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME));
+        if (send(fd_, request_.data(), request_.size(), 0) != (ssize_t)request_.size()) return false;
+
+        pollfd p{fd_, POLLIN, 0};
+        if (poll(&p, 1, ReplyTimeoutMs) <= 0) return false;
+        ssize_t len = recv(fd_, reply_, sizeof(reply_), 0);
+        nlmsghdr* h = (nlmsghdr*)reply_;
+        if (len <= 0 || !NLMSG_OK(h, (size_t)len) || h->nlmsg_type != GENL_ID_CTRL) return false;
+
+        const char* attrs = (const char*)NLMSG_DATA(h) + GENL_HDRLEN;
+        size_t attrsLen = h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+        const nlattr* id = findAttr(attrs, attrsLen, CTRL_ATTR_FAMILY_ID);
+        if (!id) return false;
+        memcpy(&family_, (const char*)id + NLA_HDRLEN, sizeof(family_));
+        return true;
+    }
+
+    static const nlattr* findAttr(const char* p, size_t len, uint16_t type) {
+        while (len >= NLA_HDRLEN) {
+            const nlattr* a = (const nlattr*)p;
+            if (a->nla_len < NLA_HDRLEN || a->nla_len > len) return nullptr;
+            if ((a->nla_type & NLA_TYPE_MASK) == type) return a;
+            size_t step = NLA_ALIGN(a->nla_len);
+            if (step >= len) return nullptr;
+            p += step;
+            len -= step;
+        }
+        return nullptr;
+    }
+
+    // Reply layout: AGGR_TGID { TGID, STATS }.
+    static bool parseStats(const nlmsghdr* h, TaskDelays& d) {
+        const char* attrs = (const char*)NLMSG_DATA(h) + GENL_HDRLEN;
+        size_t attrsLen = h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+        const nlattr* aggr = findAttr(attrs, attrsLen, TASKSTATS_TYPE_AGGR_TGID);
+        if (!aggr) return false;
+
+        const char* nested = (const char*)aggr + NLA_HDRLEN;
+        size_t nestedLen = aggr->nla_len - NLA_HDRLEN;
+        const nlattr* tgid = findAttr(nested, nestedLen, TASKSTATS_TYPE_TGID);
+        const nlattr* stats = findAttr(nested, nestedLen, TASKSTATS_TYPE_STATS);
+        if (!tgid || !stats) return false;
+
+        // Older kernels send a shorter struct; missing fields stay 0.
+        taskstats t{};
+        memcpy(&t, (const char*)stats + NLA_HDRLEN,
+               std::min<size_t>(sizeof(t), stats->nla_len - NLA_HDRLEN));
+        memcpy(&d.pid, (const char*)tgid + NLA_HDRLEN, sizeof(d.pid));
+        d.cpu = t.cpu_delay_total;
+        d.io = t.blkio_delay_total;
+        d.swap = t.swapin_delay_total;
+        d.reclaim = t.freepages_delay_total;
+        return true;
+    }
+
+    int fd_ = -1;
+    uint16_t family_ = 0;
+    uint32_t seq_ = 1;
+    std::vector<char> request_;
+    alignas(nlmsghdr) char reply_[65536];
+};
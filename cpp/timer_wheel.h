@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel: four levels of 64 slots, each slot of a level
+// spanning a whole turn of the level below. Adding, cancelling and firing a
+// timer are O(1) however many timers exist; a timer far in the future is
+// moved down one level at a time as its slot comes up.
+//
+// Time is in caller-chosen ticks. Periodic timers are re-armed at their
+// previous deadline plus the period, never at "now plus the period", so
+// they do not drift when they fire late.
+class TimerWheel {
+public:
+    using Id = uint32_t;
+    static constexpr Id None = UINT32_MAX;
+
+    TimerWheel() {
+        for (auto& level : slots_) {
+            for (Id& head : level) head = None;
+        }
+    }
+
+    uint64_t now() const { return now_; }
+
+    // Fires at `deadline`, then every `period` ticks if period > 0. A
+    // deadline that has passed fires on the next tick.
+    Id add(uint64_t deadline, uint64_t period, uint64_t tag) {
+        Id id;
+        if (!free_.empty()) {
+            id = free_.back();
+            free_.pop_back();
+        } else {
+            id = (Id)timers_.size();
+            timers_.emplace_back();
+        }
+        Timer& t = timers_[id];
+        t.deadline = deadline;
+        t.period = period;
+        t.tag = tag;
+        t.active = true;
+        link(id, now_ + 1);
+        return id;
+    }
+
+    void cancel(Id id) {
+        if (id >= timers_.size() || !timers_[id].active) return;
+        unlink(id);
+        timers_[id].active = false;
+        free_.push_back(id);
+    }
+
+    // The earliest tick at which advance() can have work to do: a timer's
+    // deadline, or a higher level's slot coming up. UINT64_MAX when idle.
+    uint64_t nextWake() const {
+        uint64_t wake = UINT64_MAX;
+        for (int level = 0; level < Levels; level++) {
+            int shift = level * SlotBits;
+            uint64_t cursor = now_ >> shift;
+            for (uint64_t i = 1; i <= Slots; i++) {
+                if (slots_[level][(cursor + i) & SlotMask] != None) {
+                    wake = std::min(wake, (cursor + i) << shift);
+                    break;
+                }
+            }
+        }
+        return wake;
+    }
+
+    // Moves time forward to `to`, appending the tag of every timer that
+    // fires, in deadline order.
+    void advance(uint64_t to, std::vector<uint64_t>& fired) {
+        while (now_ < to) {
+            now_++;
+            // Bring down the higher-level slots whose turn starts now, top first.
+            int top = 0;
+            while (top + 1 < Levels && (now_ & ((1ull << ((top + 1) * SlotBits)) - 1)) == 0) top++;
+            for (int level = top; level >= 1; level--) {
+                relinkSlot(level, (now_ >> (level * SlotBits)) & SlotMask);
+            }
+
+            Id id = takeSlot(0, now_ & SlotMask);
+            while (id != None) {
+                Id next = timers_[id].next;
+                Timer& t = timers_[id];
+                if (t.deadline <= now_) {
+                    fired.push_back(t.tag);
+                    if (t.period == 0) {
+                        t.active = false;
+                        free_.push_back(id);
+                    } else {
+                        while (t.deadline <= now_) t.deadline += t.period;
+                        link(id, now_ + 1);
+                    }
+                } else {
+                    link(id, now_ + 1);
+                }
+                id = next;
+            }
+        }
+    }
+
+private:
+    static constexpr int Levels = 4;
+    static constexpr int SlotBits = 6;
+    static constexpr uint64_t Slots = 1ull << SlotBits;
+    static constexpr uint64_t SlotMask = Slots - 1;
+
+    struct Timer {
+        uint64_t deadline = 0;
+        uint64_t period = 0;
+        uint64_t tag = 0;
+        Id prev = None, next = None;
+        uint8_t level = 0, slot = 0;
+        bool active = false;
+    };
+
+    // Level by distance to the deadline; slot by the deadline itself. Only
+    // a cascade may link into the current tick, whose slot is taken next.
+    void link(Id id, uint64_t earliest) {
+        Timer& t = timers_[id];
+        uint64_t deadline = std::max(t.deadline, earliest);
+        uint64_t delta = deadline - now_;
+        int level = 0;
+        while (level + 1 < Levels && delta >= (1ull << ((level + 1) * SlotBits))) level++;
+        uint64_t limit = 1ull << (Levels * SlotBits);
+        if (delta >= limit) deadline = now_ + limit - 1;
+
+        t.level = (uint8_t)level;
+        t.slot = (uint8_t)((deadline >> (level * SlotBits)) & SlotMask);
+        Id& head = slots_[level][t.slot];
+        t.prev = None;
+        t.next = head;
+        if (head != None) timers_[head].prev = id;
+        head = id;
+    }
+
+    void unlink(Id id) {
+        Timer& t = timers_[id];
+        if (t.prev != None) timers_[t.prev].next = t.next;
+        else slots_[t.level][t.slot] = t.next;
+        if (t.next != None) timers_[t.next].prev = t.prev;
+    }
+
+    Id takeSlot(int level, uint64_t slot) {
+        Id head = slots_[level][slot];
+        slots_[level][slot] = None;
+        return head;
+    }
+
+    void relinkSlot(int level, uint64_t slot) {
+        for (Id id = takeSlot(level, slot); id != None;) {
+            Id next = timers_[id].next;
+            link(id, now_);
+            id = next;
+        }
+    }
+
+    std::vector<Timer> timers_;
+    std::vector<Id> free_;
+    Id slots_[Levels][Slots];
+    uint64_t now_ = 0;
+};
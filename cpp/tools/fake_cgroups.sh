@@ -0,0 +1,25 @@
+#!/bin/sh
+# Builds a fake cgroup v2 tree of N leaf cgroups for load tests, so a host
+# without thousands of containers can still export ~10 series per cgroup:
+#   tools/fake_cgroups.sh /tmp/fakecg 1000
+#   MONITOR_CGROUP_ROOT=/tmp/fakecg ./server
+set -e
+root=${1:?usage: fake_cgroups.sh dir [count]}
+count=${2:-1000}
+
+mkdir -p "$root"
+: > "$root/cgroup.controllers"
+i=0
+while [ "$i" -lt "$count" ]; do
+    d="$root/bench-$i.scope"
+    mkdir -p "$d"
+    printf 'usage_usec %d\nuser_usec 0\nsystem_usec 0\n' "$((i * 1000))" > "$d/cpu.stat"
+    echo "$((i * 4096))" > "$d/memory.current"
+    printf 'anon %d\nfile %d\n' "$((i * 2048))" "$((i * 2048))" > "$d/memory.stat"
+    echo "8:0 rbytes=$i wbytes=$i rios=0 wios=0 dbytes=0 dios=0" > "$d/io.stat"
+    echo 1 > "$d/pids.current"
+    for r in cpu memory io; do
+        printf 'some avg10=0.00 avg60=0.00 avg300=0.00 total=%d\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=%d\n' "$i" "$i" > "$d/$r.pressure"
+    done
+    i=$((i + 1))
+done
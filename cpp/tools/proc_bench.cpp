@@ -0,0 +1,215 @@
+// Benchmark for the per-tick /proc reads: the original fopen/fscanf/fgets
+// getCPU(), getProcessPhysicalMemory() and getProcessVirtualMemory() against
+// the kept-open ProcFile + ProcTokenizer path that replaced them (and the
+// per-core ProcStatReader in use now). Reports ns per sample for each.
+//
+// Build (or `docker build --target bench .` from cpp/):
+//   g++ -std=c++23 -O2 -I. -o proc_bench tools/proc_bench.cpp
+// Run:
+//   ./proc_bench -n 50000
+
+#include "cpu_stats.h"
+#include "proc_reader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int samples = 50000;
+};
+
+// The original readers, copied as they were before ProcFile.
+namespace before {
+
+static unsigned long long lastTotalUser, lastTotalUserLow, lastTotalSys, lastTotalIdle;
+
+int parseLine(char* line) {
+    int i = strlen(line);
+    const char* p = line;
+    while (*p < '0' || *p > '9') p++;
+    line[i - 3] = '\0';
+    i = atoi(p);
+    return i;
+}
+
+double getProcessVirtualMemory() {
+    FILE* file = fopen("/proc/self/status", "r");
+    int result = -1;
+    char line[128];
+
+    while (fgets(line, 128, file) != NULL) {
+        if (strncmp(line, "VmSize:", 7) == 0) {
+            result = parseLine(line);
+            break;
+        }
+    }
+    fclose(file);
+    return (double)result;
+}
+
+double getProcessPhysicalMemory() {
+    FILE* file = fopen("/proc/self/status", "r");
+    double result = -1;
+    char line[128];
+
+    while (fgets(line, 128, file) != NULL) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            result = parseLine(line);
+            break;
+        }
+    }
+    fclose(file);
+    return (double)result;
+}
+
+double getCPU() {
+    FILE* file = fopen("/proc/stat", "r");
+    if (!file) return -1.0;
+
+    unsigned long long totalUser, totalUserLow, totalSys, totalIdle;
+
+    if (fscanf(file, "cpu %llu %llu %llu %llu",
+               &totalUser,
+               &totalUserLow,
+               &totalSys,
+               &totalIdle) != 4) {
+        fclose(file);
+        return -1.0;
+    }
+
+    fclose(file);
+
+    double percent;
+    unsigned long long total;
+
+    if (totalUser < lastTotalUser ||
+        totalUserLow < lastTotalUserLow ||
+        totalSys < lastTotalSys ||
+        totalIdle < lastTotalIdle) {
+        percent = -1.0;
+    } else {
+        total = (totalUser - lastTotalUser)
+              + (totalUserLow - lastTotalUserLow)
+              + (totalSys - lastTotalSys);
+
+        percent = (double)total;
+        total += (totalIdle - lastTotalIdle);
+        percent = (percent / total) * 100.0;
+    }
+
+    lastTotalUser = totalUser;
+    lastTotalUserLow = totalUserLow;
+    lastTotalSys = totalSys;
+    lastTotalIdle = totalIdle;
+
+    return (double)percent;
+}
+
+} // namespace before
+
+// The same readings through kept-open fds, as main.cpp does them.
+namespace after {
+
+static ProcFile procStat("/proc/stat");
+static ProcFile procSelfStatus("/proc/self/status");
+
+// The aggregate "cpu" row only, from the first 512 bytes.
+bool readCpu(uint64_t (&states)[4]) {
+    char buf[512];
+    ssize_t len = procStat.read(buf, sizeof(buf));
+    if (len <= 0) return false;
+
+    ProcTokenizer tok(buf, (size_t)len);
+    if (!tok.startsWith("cpu ", 4)) return false;
+    for (uint64_t& s : states) {
+        if (!tok.number(s)) return false;
+    }
+    return true;
+}
+
+bool getProcessMemory(double& physical, double& virtualMem) {
+    char buf[4096];
+    ssize_t len = procSelfStatus.read(buf, sizeof(buf));
+    if (len <= 0) return false;
+
+    uint64_t size = 0, rss = 0;
+    ProcTokenizer tok(buf, (size_t)len);
+    if (!tok.findLine("VmSize:") || !tok.number(size)) return false;
+    if (!tok.findLine("VmRSS:") || !tok.number(rss)) return false;
+
+    physical = (double)rss;
+    virtualMem = (double)size;
+    return true;
+}
+
+} // namespace after
+
+// Runs `sample` n times and returns ns per call.
+template <typename F>
+static double timePerSample(int n, F&& sample) {
+    sample(); // warm up: first open, page faults
+    auto start = Clock::now();
+    for (int i = 0; i < n; i++) sample();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-n samples]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* v = argv[++i];
+        if (!strcmp(a, "-n")) opt.samples = atoi(v);
+        else usage(argv[0]);
+    }
+    if (opt.samples <= 0) usage(argv[0]);
+
+    // Keeps the results live so the calls are not optimised away.
+    double sink = 0;
+    uint64_t states[4] = {};
+    double physical = 0, virtualMem = 0;
+
+    ProcStatReader perCore;
+    if (!perCore.open()) {
+        fprintf(stderr, "cannot open /proc/stat\n");
+        return 1;
+    }
+    uint64_t total[CpuStateCount] = {};
+    CoreTimes cores;
+
+    struct Row {
+        const char* what;
+        double ns;
+    };
+    Row rows[] = {
+        {"fscanf getCPU()", timePerSample(opt.samples, [&] { sink += before::getCPU(); })},
+        {"fgets getProcess{Physical,Virtual}Memory()", timePerSample(opt.samples, [&] {
+             sink += before::getProcessPhysicalMemory() + before::getProcessVirtualMemory();
+         })},
+        {"pread /proc/stat, cpu row", timePerSample(opt.samples, [&] {
+             if (after::readCpu(states)) sink += (double)states[0];
+         })},
+        {"pread /proc/stat, cpu + cpuN rows", timePerSample(opt.samples, [&] {
+             if (perCore.read(total, cores)) sink += (double)total[0];
+         })},
+        {"pread getProcessMemory()", timePerSample(opt.samples, [&] {
+             if (after::getProcessMemory(physical, virtualMem)) sink += physical + virtualMem;
+         })},
+    };
+
+    printf("%d samples each, %zu cores\n", opt.samples, cores.cores);
+    for (const Row& r : rows) printf("%-44s %9.0f ns/sample\n", r.what, r.ns);
+    printf("%-44s %9.0f ns/sample\n", "per tick before (fopen x3)", rows[0].ns + rows[1].ns);
+    printf("%-44s %9.0f ns/sample\n", "per tick after (pread x2, cpu row)", rows[2].ns + rows[4].ns);
+    printf("%-44s %9.0f ns/sample\n", "per tick now (pread x2, per-core rows)", rows[3].ns + rows[4].ns);
+    return sink == 0 ? 1 : 0;
+}
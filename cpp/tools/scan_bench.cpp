@@ -0,0 +1,118 @@
+// Benchmark for the per-tick process scan (process_table.h): runs
+// ProcessTable::scan(), which reads /proc/[pid]/stat on a ScanPool, with
+// 1, 2, 4 and 8 threads and reports the scan wall time per tick. Idle
+// children are forked first so /proc holds a realistic number of pids.
+//
+// Build (or `docker build --target bench .` from cpp/):
+//   g++ -std=c++23 -O2 -I. -o scan_bench tools/scan_bench.cpp -lpthread
+// Run:
+//   ./scan_bench -f 2000 -t 100 -i 100
+
+#include "process_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Options {
+    int forks = 2000;      // idle children added to /proc
+    int ticks = 100;       // timed scans per thread count
+    int intervalMs = 100;  // sleep between scans, like the sampler's tick
+    std::vector<size_t> threads = {1, 2, 4, 8};
+};
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p / 100 * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-f forks] [-t ticks] [-i interval_ms] [-n threads,...]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* v = argv[++i];
+        if (!strcmp(a, "-f")) opt.forks = atoi(v);
+        else if (!strcmp(a, "-t")) opt.ticks = atoi(v);
+        else if (!strcmp(a, "-i")) opt.intervalMs = atoi(v);
+        else if (!strcmp(a, "-n")) {
+            opt.threads.clear();
+            for (const char* p = v; *p;) {
+                opt.threads.push_back((size_t)std::max(1, atoi(p)));
+                p = strchr(p, ',');
+                if (!p) break;
+                p++;
+            }
+        } else usage(argv[0]);
+    }
+    if (opt.ticks <= 0 || opt.threads.empty()) usage(argv[0]);
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < opt.forks; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            pause();
+            _exit(0);
+        }
+        if (pid < 0) {
+            perror("fork");
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    printf("%ld CPUs online, %zu idle children forked, %d scans per run, %d ms apart\n",
+           sysconf(_SC_NPROCESSORS_ONLN), children.size(), opt.ticks, opt.intervalMs);
+    printf("%-8s %10s %10s %10s %10s %10s %8s\n",
+           "threads", "processes", "mean ms", "p50 ms", "p99 ms", "max ms", "speedup");
+
+    int rc = 0;
+    double single = 0;
+    for (size_t threads : opt.threads) {
+        ProcessTable table;
+        if (!table.open(threads)) {
+            fprintf(stderr, "cannot open /proc\n");
+            rc = 1;
+            break;
+        }
+        // The first scan sizes the table and reads every process cold.
+        table.scan();
+
+        std::vector<double> scanMs;
+        double sum = 0;
+        for (int t = 0; t < opt.ticks; t++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(opt.intervalMs));
+            if (!table.scan()) {
+                rc = 1;
+                break;
+            }
+            scanMs.push_back(table.scanMs());
+            sum += table.scanMs();
+        }
+        if (scanMs.empty()) break;
+
+        double mean = sum / scanMs.size();
+        if (single == 0) single = mean;
+        printf("%-8zu %10zu %10.2f %10.2f %10.2f %10.2f %7.2fx\n", threads, table.size(), mean,
+               percentile(scanMs, 50), percentile(scanMs, 99), percentile(scanMs, 100), single / mean);
+    }
+
+    for (pid_t pid : children) kill(pid, SIGKILL);
+    for (pid_t pid : children) waitpid(pid, nullptr, 0);
+    return rc;
+}
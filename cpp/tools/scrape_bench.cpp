@@ -0,0 +1,185 @@
+// Benchmark for GET /metrics: N scraper threads fetch the exposition back to
+// back for a fixed time and it reports throughput, latency, the body size
+// and series count, and the server CPU time spent per scrape.
+//
+// Build (or `docker build --target bench .` from cpp/):
+//   g++ -std=c++23 -O2 -I include/cpp-httplib-0.30.1 -o scrape_bench tools/scrape_bench.cpp -lpthread
+// Run against a server exporting ~10k series (10 per cgroup):
+//   tools/fake_cgroups.sh /tmp/fakecg 1000
+//   MONITOR_CGROUP_ROOT=/tmp/fakecg ./server &
+//   ./scrape_bench -c 100 -d 5 -s $(pgrep -x server)      # plain text
+//   ./scrape_bench -c 100 -d 5 -z -s $(pgrep -x server)   # gzip
+
+#include "httplib.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    const char* host = "127.0.0.1";
+    int port = 80;
+    int clients = 100;
+    double seconds = 5;
+    const char* target = "/metrics";
+    bool gzip = false;
+    bool keepAlive = false; // Prometheus opens a connection per scrape by default
+    int serverPid = 0;
+};
+
+struct ServerStatus {
+    long rssKb = -1;
+    double cpuSeconds = -1;
+};
+
+static ServerStatus serverStatus(int pid) {
+    ServerStatus s;
+    if (pid <= 0) return s;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    if (FILE* file = fopen(path, "r")) {
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "VmRSS:", 6) == 0) s.rssKb = atol(line + 6);
+        }
+        fclose(file);
+    }
+    // utime and stime are fields 14 and 15, counted after the ")" ending comm.
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (FILE* file = fopen(path, "r")) {
+        char line[1024];
+        if (fgets(line, sizeof(line), file)) {
+            const char* p = strrchr(line, ')');
+            unsigned long utime = 0, stime = 0;
+            if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                            &utime, &stime) == 2) {
+                s.cpuSeconds = (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+            }
+        }
+        fclose(file);
+    }
+    return s;
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p / 100 * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-h host] [-p port] [-c clients] [-d seconds] [-t target]\n"
+            "          [-z] [-k] [-s server_pid]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (!strcmp(a, "-z")) { opt.gzip = true; continue; }
+        if (!strcmp(a, "-k")) { opt.keepAlive = true; continue; }
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* v = argv[++i];
+        if (!strcmp(a, "-h")) opt.host = v;
+        else if (!strcmp(a, "-p")) opt.port = atoi(v);
+        else if (!strcmp(a, "-c")) opt.clients = atoi(v);
+        else if (!strcmp(a, "-d")) opt.seconds = atof(v);
+        else if (!strcmp(a, "-t")) opt.target = v;
+        else if (!strcmp(a, "-s")) opt.serverPid = atoi(v);
+        else usage(argv[0]);
+    }
+
+    // One uncompressed fetch up front to size the exposition.
+    size_t series = 0, plainBytes = 0;
+    {
+        httplib::Client cli(opt.host, opt.port);
+        auto res = cli.Get(opt.target);
+        if (!res || res->status != 200) {
+            fprintf(stderr, "GET %s failed\n", opt.target);
+            return 1;
+        }
+        plainBytes = res->body.size();
+        for (size_t pos = 0; pos < res->body.size();) {
+            size_t nl = res->body.find('\n', pos);
+            if (nl == std::string::npos) nl = res->body.size();
+            if (nl > pos && res->body[pos] != '#') series++;
+            pos = nl + 1;
+        }
+    }
+
+    struct Result {
+        std::vector<double> latencyMs;
+        size_t bytes = 0;
+        size_t errors = 0;
+    };
+    std::vector<Result> results(opt.clients);
+    std::atomic<bool> go{false};
+    ServerStatus before = serverStatus(opt.serverPid);
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration<double>(opt.seconds);
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < opt.clients; c++) {
+        threads.emplace_back([&, c] {
+            Result& r = results[c];
+            httplib::Client cli(opt.host, opt.port);
+            cli.set_keep_alive(opt.keepAlive);
+            cli.set_decompress(false); // time the server, not client-side inflate
+            cli.set_connection_timeout(5);
+            cli.set_read_timeout(5);
+            httplib::Headers headers;
+            if (opt.gzip) headers.emplace("Accept-Encoding", "gzip");
+            while (!go.load()) std::this_thread::yield();
+            while (Clock::now() < end) {
+                auto t0 = Clock::now();
+                auto res = cli.Get(opt.target, headers);
+                if (!res || res->status != 200) {
+                    r.errors++;
+                    continue;
+                }
+                r.bytes += res->body.size();
+                r.latencyMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+            }
+        });
+    }
+    go = true;
+    for (std::thread& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    ServerStatus after = serverStatus(opt.serverPid);
+
+    std::vector<double> latencyMs;
+    size_t bytes = 0, errors = 0;
+    for (Result& r : results) {
+        latencyMs.insert(latencyMs.end(), r.latencyMs.begin(), r.latencyMs.end());
+        bytes += r.bytes;
+        errors += r.errors;
+    }
+    size_t scrapes = latencyMs.size();
+
+    printf("exposition: %zu series, %zu bytes plain\n", series, plainBytes);
+    printf("scrapers: %d%s%s, %zu scrapes in %.1f s (%.0f/s), %zu errors\n",
+           opt.clients, opt.gzip ? ", gzip" : "", opt.keepAlive ? ", keep-alive" : "",
+           scrapes, elapsed, scrapes / elapsed, errors);
+    printf("body: %zu bytes average\n", scrapes ? bytes / scrapes : 0);
+    printf("latency: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           percentile(latencyMs, 50), percentile(latencyMs, 99), percentile(latencyMs, 100));
+    if (opt.serverPid > 0 && before.cpuSeconds >= 0 && after.cpuSeconds >= 0) {
+        double cpu = after.cpuSeconds - before.cpuSeconds;
+        printf("server: %.2f CPU s (%.3f ms per scrape), RSS %ld -> %ld KB\n",
+               cpu, scrapes ? cpu * 1000 / scrapes : 0.0, before.rssKb, after.rssKb);
+    }
+    return scrapes > 0 && errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// Benchmark for the on-disk history (segment_store.h): writes a month of
+// synthetic samples once, then measures a cold start (opening every segment
+// with the files evicted from the page cache), bytes per value, and history
+// queries served from segment summaries and by decoding the stream.
+//
+// Build (or `docker build --target bench .` from cpp/):
+//   g++ -std=c++23 -O2 -I. -o segment_bench tools/segment_bench.cpp
+// Run (the data directory is reused when it already holds segments):
+//   ./segment_bench -o /var/tmp/segment_bench -d 30 -c 70
+
+#include "segment_store.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string dir = "/var/tmp/segment_bench";
+    int days = 30;
+    int columns = 70;
+    int periodMs = 1000;
+    bool fullDecode = false; // also time a month decoded sample by sample
+};
+
+static double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Sizes of the segment files; evicts them from the page cache when asked.
+static uint64_t segmentFiles(const std::string& dir, bool evict, size_t& files) {
+    uint64_t bytes = 0;
+    files = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return 0;
+    while (dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".seg") != 0) continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) bytes += (uint64_t)st.st_size;
+        files++;
+        if (evict) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                fdatasync(fd);
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                close(fd);
+            }
+        }
+    }
+    closedir(d);
+    return bytes;
+}
+
+// A third of the columns move like CPU percentages, a third like byte
+// counts that change slowly, and a third like per-second rates.
+static void generate(SegmentStore& store, const Options& opt, int64_t from, int64_t to) {
+    std::vector<double> values(opt.columns);
+    uint64_t rng = 88172645463325252ull;
+    auto next = [&] {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return (double)(rng >> 11) / (double)(1ull << 53);
+    };
+    for (int c = 0; c < opt.columns; c++) values[c] = c % 3 == 1 ? 8e9 : 10;
+
+    for (int64_t ts = from; ts <= to; ts += opt.periodMs) {
+        for (int c = 0; c < opt.columns; c++) {
+            double& v = values[c];
+            if (c % 3 == 0) v = std::clamp(v + (next() - 0.5) * 4, 0.0, 100.0);
+            else if (c % 3 == 1) v += next() < 0.1 ? (next() - 0.5) * 1e6 : 0;
+            else v = std::max(0.0, v + (next() - 0.5) * 20);
+        }
+        store.append(ts, values.data());
+    }
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-o dir] [-d days] [-c columns] [-p period_ms] [-f]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (!strcmp(a, "-f")) { opt.fullDecode = true; continue; }
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* v = argv[++i];
+        if (!strcmp(a, "-o")) opt.dir = v;
+        else if (!strcmp(a, "-d")) opt.days = atoi(v);
+        else if (!strcmp(a, "-c")) opt.columns = atoi(v);
+        else if (!strcmp(a, "-p")) opt.periodMs = atoi(v);
+        else usage(argv[0]);
+    }
+
+    std::vector<std::string> names;
+    std::vector<int> decimals;
+    for (int c = 0; c < opt.columns; c++) {
+        names.push_back("metric_" + std::to_string(c));
+        decimals.push_back(c % 3 == 0 ? 2 : c % 3 == 1 ? 0 : 1);
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    now -= now % opt.periodMs;
+    int64_t from = now - (int64_t)opt.days * 86400 * 1000;
+    uint64_t samples = (uint64_t)((now - from) / opt.periodMs + 1);
+
+    size_t files = 0;
+    if (segmentFiles(opt.dir, false, files) == 0) {
+        auto start = Clock::now();
+        SegmentStore store(opt.dir, names, decimals);
+        if (!store.open()) {
+            fprintf(stderr, "cannot open %s\n", opt.dir.c_str());
+            return 1;
+        }
+        generate(store, opt, from, now);
+        printf("generated %d days of %d columns every %d ms in %.1f s\n",
+               opt.days, opt.columns, opt.periodMs, msSince(start) / 1000);
+    } else {
+        printf("reusing %s\n", opt.dir.c_str());
+    }
+
+    uint64_t bytes = segmentFiles(opt.dir, true, files);
+    printf("disk: %zu segments, %.1f MB, %.2f bytes per value (headers and summaries included)\n",
+           files, bytes / 1e6, (double)bytes / ((double)samples * opt.columns));
+
+    // Cold start: the page cache was just dropped for every segment.
+    auto start = Clock::now();
+    SegmentStore store(opt.dir, names, decimals);
+    if (!store.open()) return 1;
+    printf("cold start: open() in %.1f ms\n", msSince(start));
+
+    int64_t oldest = store.oldest();
+    struct Query {
+        const char* what;
+        int64_t from;
+        int64_t step;
+    };
+    std::vector<Query> queries = {
+        {"month, 1 h step (summaries)", oldest, 3600 * 1000},
+        {"month, 1 min step (summaries)", oldest, 60 * 1000},
+        {"day, 10 s step (decoded)", now - 86400 * 1000, 10 * 1000},
+    };
+    if (opt.fullDecode) queries.push_back({"month, 59 s step (decoded)", oldest, 59 * 1000});
+    for (const Query& q : queries) {
+        start = Clock::now();
+        SegmentStore::Series series = store.query(q.from, now, q.step);
+        printf("query %-32s %8.1f ms, %zu points\n", q.what, msSince(start), series.timestamps.size());
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Load test for /metrics/stream: opens N SSE subscribers at once from one
+// epoll thread, as after a server restart, and reports how long they took to
+// connect, how many receive frames, the server's memory and thread count,
+// and delivery latency: receipt time minus the frame's snapshot timestamp.
+// Run it on the server's host so both clocks are the same.
+//
+// Build (or `docker build --target bench .` from cpp/):
+//   g++ -std=c++23 -O2 -o stream_load tools/stream_load.cpp
+// Run against a server on this host:
+//   ./stream_load -n 5000 -d 10 -s $(pgrep -x server)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    const char* host = "127.0.0.1";
+    int port = 80;
+    int connections = 5000;
+    double seconds = 10;
+    double warmup = 2;
+    const char* target = "/metrics/stream?metrics=cpu,timestamp";
+    int serverPid = 0;
+};
+
+struct Conn {
+    int fd = -1;
+    bool sent = false;
+    bool headerDone = false;
+    std::string pending; // partial frame
+    size_t frames = 0;
+};
+
+struct ServerStatus {
+    long rssKb = -1;
+    long threads = -1;
+};
+
+static ServerStatus serverStatus(int pid) {
+    ServerStatus s;
+    if (pid <= 0) return s;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* file = fopen(path, "r");
+    if (!file) return s;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) s.rssKb = atol(line + 6);
+        else if (strncmp(line, "Threads:", 8) == 0) s.threads = atol(line + 8);
+    }
+    fclose(file);
+    return s;
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p / 100 * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-h host] [-p port] [-n connections] [-d seconds] [-w warmup]\n"
+            "          [-t target] [-s server_pid]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* a = argv[i];
+        const char* v = argv[++i];
+        if (!strcmp(a, "-h")) opt.host = v;
+        else if (!strcmp(a, "-p")) opt.port = atoi(v);
+        else if (!strcmp(a, "-n")) opt.connections = atoi(v);
+        else if (!strcmp(a, "-d")) opt.seconds = atof(v);
+        else if (!strcmp(a, "-w")) opt.warmup = atof(v);
+        else if (!strcmp(a, "-t")) opt.target = v;
+        else if (!strcmp(a, "-s")) opt.serverPid = atoi(v);
+        else usage(argv[0]);
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)opt.port);
+    if (inet_pton(AF_INET, opt.host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", opt.host);
+        return 1;
+    }
+
+    ServerStatus before = serverStatus(opt.serverPid);
+    std::string request = std::string("GET ") + opt.target + " HTTP/1.1\r\nHost: " + opt.host + "\r\n\r\n";
+
+    // Every connect is started before any completes, so the server's accept
+    // backlog takes the whole burst.
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Conn> conns(opt.connections);
+    int open = 0;
+    int failed = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < opt.connections; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd < 0 || (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS)) {
+            fprintf(stderr, "connection %d: %s\n", i, strerror(errno));
+            if (fd >= 0) close(fd);
+            break;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+        conns[i].fd = fd;
+        open++;
+    }
+
+    int responded = 0;
+    double connectedSeconds = -1;
+    auto measureFrom = start + std::chrono::duration<double>(opt.warmup);
+    auto end = measureFrom + std::chrono::duration<double>(opt.seconds);
+    std::vector<double> latencyMs;
+    int closed = 0;
+
+    std::vector<epoll_event> events(1024);
+    char buf[65536];
+    while (Clock::now() < end) {
+        int n = epoll_wait(epollFd, events.data(), (int)events.size(), 100);
+        for (int e = 0; e < n; e++) {
+            Conn& c = conns[events[e].data.u32];
+            if (c.fd < 0) continue;
+            if (!c.sent && (events[e].events & EPOLLOUT)) {
+                int err = 0;
+                socklen_t errLen = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+                if (err != 0 || send(c.fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+                    close(c.fd);
+                    c.fd = -1;
+                    failed++;
+                    continue;
+                }
+                c.sent = true;
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLRDHUP;
+                ev.data.u32 = events[e].data.u32;
+                epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+            }
+            for (;;) {
+                ssize_t len = recv(c.fd, buf, sizeof(buf), 0);
+                if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (len <= 0) {
+                    close(c.fd);
+                    c.fd = -1;
+                    closed++;
+                    break;
+                }
+                auto now = Clock::now();
+                int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                c.pending.append(buf, (size_t)len);
+                if (!c.headerDone) {
+                    size_t head = c.pending.find("\r\n\r\n");
+                    if (head == std::string::npos) continue;
+                    c.pending.erase(0, head + 4);
+                    c.headerDone = true;
+                    if (++responded == opt.connections) {
+                        connectedSeconds = std::chrono::duration<double>(now - start).count();
+                    }
+                }
+                // Frames end with a blank line; only "data:" frames with a
+                // snapshot timestamp are ticks.
+                for (size_t pos; (pos = c.pending.find("\n\n")) != std::string::npos;) {
+                    size_t ts = c.pending.compare(0, 5, "data:") == 0
+                        ? c.pending.find("\"timestamp\":") : std::string::npos;
+                    if (ts < pos) {
+                        c.frames++;
+                        if (now >= measureFrom) {
+                            latencyMs.push_back((double)(nowMs - atoll(c.pending.c_str() + ts + 12)));
+                        }
+                    }
+                    c.pending.erase(0, pos + 2);
+                }
+            }
+        }
+    }
+
+    ServerStatus after = serverStatus(opt.serverPid);
+    int receiving = 0;
+    for (const Conn& c : conns) {
+        if (c.fd >= 0 && c.frames > 1) receiving++;
+    }
+
+    printf("connections: %d requested, %d started, %d failed, %d closed by server, %d receiving frames\n",
+           opt.connections, open, failed, closed, receiving);
+    if (connectedSeconds >= 0) printf("all connected after %.2f s\n", connectedSeconds);
+    else printf("not all connected within %.1f s\n", opt.warmup + opt.seconds);
+    printf("frames measured: %zu over %.1f s\n", latencyMs.size(), opt.seconds);
+    printf("delivery latency: p50 %.0f ms, p99 %.0f ms, max %.0f ms\n",
+           percentile(latencyMs, 50), percentile(latencyMs, 99), percentile(latencyMs, 100));
+    if (opt.serverPid > 0) {
+        printf("server: RSS %ld -> %ld KB (%.1f KB per connection), threads %ld -> %ld\n",
+               before.rssKb, after.rssKb,
+               open > 0 ? (double)(after.rssKb - before.rssKb) / open : 0.0,
+               before.threads, after.threads);
+    }
+
+    for (Conn& c : conns) {
+        if (c.fd >= 0) close(c.fd);
+    }
+    close(epollFd);
+    return receiving == open && open == opt.connections ? 0 : 1;
+}
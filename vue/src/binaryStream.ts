@@ -0,0 +1,130 @@
+// Decoder for the backend's /metrics/stream?format=bin stream.
+// Frame layout is documented in cpp/bin_codec.h.
+
+export type Metrics = Record<string, number | number[]>
+
+interface Field {
+    name: string
+    isArray: boolean
+    scale: number
+    length: number
+}
+
+const SchemaFrame = 1
+const DeltaFrame = 2
+
+export class BinaryStreamDecoder {
+    private pending = new Uint8Array(0)
+    private fields: Field[] = []
+    private values: number[] = []
+    private pos = 0
+    private bytes = new Uint8Array(0)
+
+    // Appends a chunk and returns the metrics of every complete delta frame.
+    push(chunk: Uint8Array): Metrics[] {
+        const merged = new Uint8Array(this.pending.length + chunk.length)
+        merged.set(this.pending)
+        merged.set(chunk, this.pending.length)
+        this.bytes = merged
+        this.pos = 0
+
+        const out: Metrics[] = []
+        for (;;) {
+            const start = this.pos
+            const len = this.varint()
+            if (len < 0 || this.pos + len > merged.length) {
+                this.pos = start
+                break
+            }
+            const end = this.pos + len
+            const type = merged[this.pos++]
+            if (type === SchemaFrame) this.readSchema()
+            else if (type === DeltaFrame) out.push(this.readDelta())
+            this.pos = end
+        }
+
+        this.pending = merged.slice(this.pos)
+        return out
+    }
+
+    // Returns -1 if the buffer ends inside the varint.
+    private varint(): number {
+        let value = 0
+        let mul = 1
+        while (this.pos < this.bytes.length) {
+            const b = this.bytes[this.pos++]
+            value += (b & 0x7f) * mul
+            if (b < 0x80) return value
+            mul *= 128
+        }
+        return -1
+    }
+
+    private zigzag(): number {
+        const n = this.varint()
+        return n % 2 === 0 ? n / 2 : -(n + 1) / 2
+    }
+
+    private readSchema() {
+        const count = this.varint()
+        const decoder = new TextDecoder()
+        this.fields = []
+        for (let i = 0; i < count; i++) {
+            const nameLen = this.varint()
+            const name = decoder.decode(this.bytes.subarray(this.pos, this.pos + nameLen))
+            this.pos += nameLen
+            const isArray = this.bytes[this.pos++] === 1
+            const decimals = this.bytes[this.pos++]
+            const length = this.varint()
+            this.fields.push({ name, isArray, scale: Math.pow(10, decimals), length })
+        }
+        const total = this.fields.reduce((n, f) => n + f.length, 0)
+        this.values = new Array(total).fill(0)
+    }
+
+    private readDelta(): Metrics {
+        this.varint() // sequence number
+        for (let i = 0; i < this.values.length; i++) {
+            this.values[i] += this.zigzag()
+        }
+
+        const metrics: Metrics = {}
+        let i = 0
+        for (const f of this.fields) {
+            if (f.isArray) {
+                const arr: number[] = new Array(f.length)
+                for (let j = 0; j < f.length; j++) arr[j] = this.values[i++] / f.scale
+                metrics[f.name] = arr
+            } else {
+                metrics[f.name] = this.values[i++] / f.scale
+            }
+        }
+        return metrics
+    }
+}
+
+// Streams decoded metrics from `url` until the returned function is called.
+export function connectBinaryStream(
+    url: string,
+    onMetrics: (m: Metrics) => void,
+    onError: (err: unknown) => void
+): () => void {
+    const controller = new AbortController()
+    const decoder = new BinaryStreamDecoder()
+
+    fetch(url, { signal: controller.signal, cache: 'no-store' })
+        .then(async (res) => {
+            if (!res.ok || !res.body) throw new Error('HTTP ' + res.status)
+            const reader = res.body.getReader()
+            for (;;) {
+                const { done, value } = await reader.read()
+                if (done) throw new Error('stream closed')
+                for (const m of decoder.push(value)) onMetrics(m)
+            }
+        })
+        .catch((err) => {
+            if (!controller.signal.aborted) onError(err)
+        })
+
+    return () => controller.abort()
+}